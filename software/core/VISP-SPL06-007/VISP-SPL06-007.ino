@@ -46,9 +46,15 @@
 #include <FastPID.h>
 
 #define PATIENT_CHECK_INTERVAL 20
-float Kp=0.85, Ki=0.09, Kd=0.023, Hz=(1000/PATIENT_CHECK_INTERVAL);
+#ifdef WANT_CONTROL_TIMER
+#define PID_HZ CONTROL_TICK_HZ
+#else
+#define PID_HZ (1000/PATIENT_CHECK_INTERVAL)
+#endif
+float Kp=0.85, Ki=0.09, Kd=0.023, Hz=PID_HZ;
 int output_bits = 8;
 bool output_signed = false;
+// With WANT_CONTROL_TIMER the control tick steps it, anything else has to hold off interrupts
 FastPID myPID(Kp, Ki, Kd, Hz, output_bits, output_signed);
 
 #ifdef ARDUINO_TEENSY40
@@ -112,28 +118,7 @@ int8_t FiO2Level;
 // Put a transistor inverter on ENABLE_PIN_BUS_A to eliminate needing the second ENABLE_PIN_BUS_B
 //
 
-/*** Timer callback subsystem ***/
-
-typedef void (*tCBK)() ;
-typedef struct t  {
-  unsigned long tStart;
-  unsigned int  tTimeout; // 64 second max timeout
-  tCBK cbk;
-} t_t;
-
-
-unsigned long tCheck (struct t * t ) {
-  unsigned long accrued = 0L;
-
-  if (millis() > t->tStart + t->tTimeout)
-  {
-    unsigned long startTime = micros();
-    t->cbk();
-    t->tStart = millis();
-    accrued += (micros() - startTime);
-  }
-  return accrued;
-}
+/*** Timer callback subsystem (see scheduler.cpp) ***/
 
 // Periodically pulse a pin
 void __NOINLINE timeToPulseWatchdog()
@@ -144,43 +129,164 @@ void __NOINLINE timeToPulseWatchdog()
     delayMicroseconds(1);
     digitalWrite(MISSING_PULSE_PIN, LOW);
   }
-
-  // Save some flash code space and do this often, the display code prints 1 line per invocation, and has 2 displays to output to.
-  // 8 lines of text being updated, so we need to do this every 100ms or so.
-  displayUpdate();
 }
 
-void timeToReadVISP()
+// Read all of the sensors and turn them into pressure and volume (unless we are calibrating)
+// Returns false if the sensors are missing, or have just gone missing.
+bool readVISP()
 {
-  // Read them all NOW
-  if (sensorsFound)
+  if (!sensorsFound)
+    return false;
+#ifdef WANT_SAMPLING_PROFILES
+  if (baroProfileSettling())
+    return false;
+#endif
+
+  // Get all the reads onto the buses first, each baroCalculate() then only waits for its own.
+  // Every bus has its own queue, so on a dual I2C VISP U5/U6 on Wire and U7/U8 on Wire1
+  // are sampled at the same time.  U5 (throat) and U7 (inlet) go first on their buses, they
+  // are the pair that the venturi flow comes from.  A muxed VISP is visited a channel at a
+  // time, starting with the one the mux is on, so it only switches once.
+#if defined(WANT_TASK_STATS) || defined(WANT_SAMPLING_PROFILES)
+  unsigned long startMicros = micros();
+#endif
+  busDevice_t *devs[4];
+  uint8_t order[4];
+  for (int8_t x = 0; x < 4; x++)
+    devs[x] = sensors[x].busDev;
+  busDeviceVisitOrder(devs, 4, order);
+
+#ifdef WANT_COHERENT_SAMPLING
+  // Every sensor converts at the same time, started at the end of the last call.  The first
+  // time around there is nothing to read yet.
+  static bool pressuresConverted;
+  if (!baroWaitConversions())
   {
-    // If any of the sensors fail, stop trying to do others
+    pressuresConverted = baroTriggerAll(order);
+    return false;
+  }
+#endif
+
+#ifdef WANT_SENSOR_DRDY
+  // Only the sensors with a new sample, the others would give us the same one again
+  uint8_t ready = baroDataReady();
+  if (!ready)
+    return false;
+#else
+  uint8_t ready = 0x0F;
+#endif
+#define isReady(x) (ready & (1 << (x)))
+
+  if (sensors[SENSOR_U5].busDev->busType == BUSTYPE_I2C && sensors[SENSOR_U5].busDev->busdev.i2c.i2cBus != sensors[SENSOR_U7].busDev->busdev.i2c.i2cBus)
+  {
+    if (isReady(SENSOR_U5))
+      baroStartRead(&sensors[SENSOR_U5]);
+    if (isReady(SENSOR_U7))
+      baroStartRead(&sensors[SENSOR_U7]);
+  }
+  for (int8_t x = 0; x < 4; x++)
+    if (isReady(order[x]))
+      baroStartRead(&sensors[order[x]]);
+
+  // A sensor that misses a sample keeps its last reading, the rest still have to be picked up.
+  // One that keeps missing is given up on by baroCalculate() (BARO_FAILED_SAMPLES_MAX).
+  uint8_t calculated = 0;
+  for (int8_t x = 0; x < 4; x++)
+  {
+    if (!sensorsFound) // Given up on, the sensors are gone
+      return false;
+    if (!isReady(order[x]))
+      continue;
+    if (baroCalculate(&sensors[order[x]]))
+      calculated |= (1 << order[x]);
+  }
+  busStatsSample();
+#ifdef WANT_COHERENT_SAMPLING
+  // The next set converts while this one is worked on.  A set that an SPL06 spent on its
+  // temperature has a stale pressure in it, so it is not used.
+  bool havePressures = pressuresConverted;
+  pressuresConverted = baroTriggerAll(order);
+  if (!havePressures)
+    return false;
+#endif
+#if defined(WANT_TASK_STATS) || defined(WANT_SAMPLING_PROFILES)
+  {
+    unsigned long first = 0, last = 0;
+    bool any = false;
     for (int8_t x = 0; x < 4; x++)
     {
-      if (!sensors[x].calculate(&sensors[x]))
-        return;
+      if (!(calculated & (1 << x))) // A missed one has an old time
+        continue;
+      if (!any || (long)(sensorData.sampleMicros[x] - first) < 0)
+        first = sensorData.sampleMicros[x];
+      if (!any || (long)(sensorData.sampleMicros[x] - last) > 0)
+        last = sensorData.sampleMicros[x];
+      any = true;
+    }
+#ifdef WANT_TASK_STATS
+    if (any)
+    {
+      taskStatsRecord(&backgroundStats[STATS_SENSOR_ACQUIRE], last - startMicros);
+      taskStatsRecord(&backgroundStats[STATS_SENSOR_SKEW], last - first);
     }
+#endif
+#ifdef WANT_SAMPLING_PROFILES
+    if (any)
+      baroProfileRecord(SENSOR_U6, last - startMicros);
+#endif
   }
+#endif
+#undef isReady
+
   // OK, the cable might have just been unplugged, and the sensors have gone away.
   // Hence the double checks one above, and this one below
+  if (!sensorsFound)
+    return false;
+
+  if (!calibrateInProgress())
+  {
+    calibrateApply();
+
+    if (visp_eeprom.bodyType == 'P')
+      calculatePitotValues();
+    else
+      calculateVenturiValues();
+    // TidalVolume is the same for both versions
+    calculateTidalVolume();
+  }
+  // calibrateSensors() needs the raw pressures too
+  vispPublishSample();
+  return true;
+}
+
+#if defined(WANT_SENSOR_DRDY) && !defined(WANT_CONTROL_TIMER)
+#define READ_VISP_INTERVAL   1 // Looking for a data ready, readVISP() does nothing without one
+#else
+#define READ_VISP_INTERVAL  20
+#endif
+#define REPORT_VISP_INTERVAL 20
+
+void timeToReadVISP()
+{
+#ifdef WANT_CONTROL_TIMER
+  // The control tick did the reading, we just report on it
+  vispReportSensorFailure();
   if (sensorsFound)
+#elif defined(WANT_SENSOR_DRDY)
+  static unsigned long nextReport;
+
+  // The sensors are read as soon as they have something, the reports keep their pace
+  if (!readVISP() || !timeReached(millis(), nextReport))
+    return;
+  nextReport = millis() + REPORT_VISP_INTERVAL;
+#else
+  if (readVISP())
+#endif
   {
     if (calibrateInProgress())
       calibrateSensors();
     else
-    {
-      calibrateApply();
-
-      if (visp_eeprom.bodyType == 'P')
-        calculatePitotValues();
-      else
-        calculateVenturiValues();
-      // TidalVolume is the same for both versions
-      calculateTidalVolume();
-      // Take some time to write to the serial port
-      dataSend();
-    }
+      dataSend(); // Take some time to write to the serial port
   }
 }
 
@@ -191,6 +297,93 @@ volatile unsigned long timeToIgnoreHome = 0;
 
 #define isInInhaleCycle() (timeToStopInhale > 0)
 
+// One step of the PID, returns the new motor speed
+int8_t controlStep()
+{
+  PROFILE_SCOPE(PROFILE_CONTROL_STEP);
+  int16_t speed = 0;
+
+  TRACE(TRACE_PID_START, 0, 0);
+
+  switch (currentMode)
+  {
+    case MODE_MANUAL_PCCMV:
+    case MODE_PCCMV:
+      speed = myPID.step(breathPressure, pressure); // (setpoint, feedback)
+      break;
+    case MODE_MANUAL_VCCMV:
+    case MODE_VCCMV:
+      speed = myPID.step(breathVolume, volume); // (setpoint, feedback)
+      break;
+  }
+  if (speed > motorMaxSpeed)
+    speed = motorMaxSpeed;
+  TRACE(TRACE_PID_END, 0, speed);
+  return speed;
+}
+
+#ifdef WANT_CONTROL_TIMER
+// Sampling and the PID run from a hardware timer, so FastPID really does see CONTROL_TICK_HZ
+// no matter how long the displays, serial output or sensor detection take in loop().
+// Nothing in here may print, the results are handed to loop() instead:
+//   sensor data through vispPublishSample()/vispReadSample(),
+//   the motor speed through controlOutput/controlOutputSequence (applied by controlApply()).
+IntervalTimer controlTimer;
+volatile bool inControlTick = false;
+volatile int8_t controlOutput = 0;
+volatile uint8_t controlOutputSequence = 0;
+
+void controlTick()
+{
+#ifdef WANT_TASK_STATS
+  unsigned long startMicros = micros();
+#endif
+
+  inControlTick = true;
+
+  // loop() was interrupted part way through an I2C transaction (display, detection, EEPROM),
+  // so stay off the bus and run the PID on the previous sample this time around.
+  if (busInUse)
+  {
+#ifdef WANT_TASK_STATS
+    if (backgroundStats[STATS_CONTROL_TICK].misses != 0xFFFF)
+      backgroundStats[STATS_CONTROL_TICK].misses++;
+#endif
+  }
+  else
+    readVISP();
+
+  if (sensorsFound && isInInhaleCycle() && !calibrateInProgress())
+  {
+    controlOutput = controlStep();
+    controlOutputSequence++;
+  }
+
+  inControlTick = false;
+
+#ifdef WANT_TASK_STATS
+  taskStatsRecord(&backgroundStats[STATS_CONTROL_TICK], micros() - startMicros);
+#endif
+}
+
+// Called from loop(), the motor drivers report their speed over the serial port
+void controlApply()
+{
+  static uint8_t lastSequence = 0;
+  uint8_t sequence = controlOutputSequence;
+
+  if (sequence != lastSequence)
+  {
+    lastSequence = sequence;
+    if (isInInhaleCycle())
+    {
+      motorSpeed = controlOutput;
+      motorGo();
+    }
+  }
+}
+#endif
+
 void timeToCheckPatient()
 {
   unsigned long theMillis = millis();
@@ -235,23 +428,19 @@ void timeToCheckPatient()
     {
       // TODO: if in the middle of the inhalation time, and we don't have any pressure from the VISP,
       // TODO: either we have a motor fault or we have a disconnected tube
+#ifndef WANT_CONTROL_TIMER
+      // Otherwise, controlTick() runs the PID and controlApply() drives the motor
       switch (currentMode)
       {
         case MODE_MANUAL_PCCMV:
         case MODE_PCCMV:
-          motorSpeed = myPID.step(breathPressure, pressure); // (setpoint, feedback)
-          if ( motorSpeed > motorMaxSpeed)
-            motorSpeed = motorMaxSpeed;
-          motorGo();
-          break;
         case MODE_MANUAL_VCCMV:
-        case MODE_VCCMV:          
-          motorSpeed = myPID.step(breathVolume, volume); // (setpoint, feedback)
-          if ( motorSpeed > motorMaxSpeed)
-            motorSpeed = motorMaxSpeed;
+        case MODE_VCCMV:
+          motorSpeed = controlStep();
           motorGo();
           break;
       }
+#endif
     }
   }
 }
@@ -271,12 +460,11 @@ void __NOINLINE enableI2cBusB(busDevice_t *busDevice, bool enableFlag)
 
 void timeToCheckSensors()
 {
-  // If debug is on, and a VISP is NOT connected, we flood the system with sensor scans.
-  // Do it every half second (or longer)
+  // detectVISP() is a protothread, each call does a little of the detection and returns.
+  // It waits half a second between scans so a missing VISP does not flood the system with them.
   if (!sensorsFound)
   {
-    detectVISP(i2cBus1, i2cBus2, enableI2cBusA, enableI2cBusB);
-    if (sensorsFound)
+    if (detectVISP(i2cBus1, i2cBus2, enableI2cBusA, enableI2cBusB) >= PT_EXITED && sensorsFound)
       displaySetup(i2cBus1); // Need to setup the VISP I2C OLED that just attached
   }
 
@@ -317,17 +505,27 @@ void __NOINLINE timeToSendHealthStatus()
 }
 
 
+// Task names for the 'T' statistics report
+const char strTaskReadVISP[] PUTINFLASH = "readVISP";
+const char strTaskCheckPatient[] PUTINFLASH = "checkPatient";
+const char strTaskPulseWatchdog[] PUTINFLASH = "pulseWatchdog";
+const char strTaskCheckADC[] PUTINFLASH = "checkADC";
+const char strTaskCheckSensors[] PUTINFLASH = "checkSensors";
+const char strTaskSendHealth[] PUTINFLASH = "sendHealth";
+const char strTaskServiceEEPROM[] PUTINFLASH = "serviceEEPROM";
+
 // Timer Driven Tasks and their Schedules.
-// These are checked and executed in order.
+// When more than one task is due, they are executed in table order.
 // If something takes priority over another task, put it at the top of the list
-t tasks[] = {
-  {0, 20, timeToReadVISP},
-  {0, PATIENT_CHECK_INTERVAL,  timeToCheckPatient},
-  {0, 100, timeToPulseWatchdog},
-  //  {0, 200, timeToCheckADC}, // disabled for now
-  {0, 500, timeToCheckSensors},
-  {0, 3000, timeToSendHealthStatus},
-  {0, 0, NULL} // End of list
+task_t tasks[] = {
+  {0, READ_VISP_INTERVAL, TASK_FIXED_RATE, timeToReadVISP, strTaskReadVISP},
+  {0, PATIENT_CHECK_INTERVAL, TASK_FIXED_RATE, timeToCheckPatient, strTaskCheckPatient},
+  {0, 100, TASK_FIXED_RATE, timeToPulseWatchdog, strTaskPulseWatchdog},
+  //  {0, 200, TASK_FIXED_RATE, timeToCheckADC, strTaskCheckADC}, // disabled for now
+  {0, 10, TASK_FIXED_DELAY, timeToCheckSensors, strTaskCheckSensors}, // Polls the detection protothread
+  {0, 3000, TASK_FIXED_RATE, timeToSendHealthStatus, strTaskSendHealth},
+  {0, 1, TASK_FIXED_DELAY, eepromService, strTaskServiceEEPROM}, // One EEPROM page (or write cycle poll) at a time
+  {0, 0, TASK_FIXED_RATE, NULL, NULL} // End of list
 };
 
 /*** End of timer callback subsystem ***/
@@ -355,7 +553,7 @@ void initI2C(TwoWire * wire)
   if (wire)
   {
     wire->begin();
-    wire->setClock(400000); // Typical 400KHz
+    busClockInit(wire); // Typical 400KHz, until busClockNegotiate() has had a look at the VISP
   }
 }
 
@@ -364,8 +562,16 @@ void setup()
   hwSerial.begin(SERIAL_BAUD);
   respond('I', PSTR("VISP Core,%d,%d,%d"), VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION);
 
+  profileInit();
+
   initI2C(i2cBus1);
   initI2C(i2cBus2);
+#ifdef VISP_SPI_CS_U8
+  SPI.begin();
+#endif
+#ifdef WANT_SENSOR_DRDY
+  baroDrdyInit();
+#endif
 
   // Address select lines for Dual I2C switching using NPN Transistors
 #ifdef ENABLE_PIN_BUS_A
@@ -379,7 +585,9 @@ void setup()
   pinMode(MISSING_PULSE_PIN, OUTPUT);
   digitalWrite(MISSING_PULSE_PIN, LOW);
 
+  noInterrupts();
   myPID.setOutputRange(0, 100);
+  interrupts();
 
   motorSetup();
 
@@ -402,6 +610,13 @@ void setup()
 
   // primeTheFrontEnd();
   sendCurrentSystemHealth();
+
+  schedulerInit(tasks);
+
+#ifdef WANT_CONTROL_TIMER
+  controlTimer.priority(CONTROL_TICK_PRIORITY);
+  controlTimer.begin(controlTick, 1000000 / CONTROL_TICK_HZ);
+#endif
 }
 
 
@@ -414,11 +629,23 @@ unsigned long utilizationTimeout = 0;
 // loop() gets called repeatedly forever, so there is no 'idle' time
 // do not compute the time checking for things to be done, only compute the time we do things.
 void loop() {
-  unsigned long startMicros;
+  unsigned long startMicros, elapsedMicros;
+#ifdef WANT_TASK_STATS
+  static unsigned long lastLoopMicros = 0;
+#endif
 
   startMicros = micros();
+#ifdef WANT_TASK_STATS
+  if (lastLoopMicros)
+    taskStatsRecord(&backgroundStats[STATS_LOOP], startMicros - lastLoopMicros);
+  lastLoopMicros = startMicros;
+#endif
   motorRun();
-  currentUtilization += micros() - startMicros;
+  elapsedMicros = micros() - startMicros;
+  currentUtilization += elapsedMicros;
+#ifdef WANT_TASK_STATS
+  taskStatsRecord(&backgroundStats[STATS_MOTOR_RUN], elapsedMicros);
+#endif
 
   if (homeHasBeenTriggered)
   {
@@ -435,21 +662,38 @@ void loop() {
     }
   }
 
-  for (t_t *entry = tasks; entry->cbk; entry++)
-    currentUtilization += tCheck(entry);
+#ifdef WANT_CONTROL_TIMER
+  controlApply();
+#endif
+
+  currentUtilization += schedulerRun();
 
   // Command parser uses >6K bytes of flash... This is a LOT
   // Handle user input, 1 character at a time
   startMicros = micros();
   while (hwSerial.available())
     commandParser(hwSerial.read());
+#ifdef WANT_TASK_STATS
+  taskStatsRecord(&backgroundStats[STATS_COMMAND_PARSER], micros() - startMicros);
+#endif
 
   // Spread out the writing of the EEPROM over time
   coreSaveSettingsStateMachine();
 
   currentUtilization += micros() - startMicros;
 
-  if (millis() > utilizationTimeout)
+  // Lowest priority, the displays get what is left over (in DISPLAY_BUDGET_MICROS slices)
+  startMicros = micros();
+  if (displayUpdate())
+  {
+    elapsedMicros = micros() - startMicros;
+    currentUtilization += elapsedMicros;
+#ifdef WANT_TASK_STATS
+    taskStatsRecord(&backgroundStats[STATS_DISPLAY_UPDATE], elapsedMicros);
+#endif
+  }
+
+  if (timeReached(millis(), utilizationTimeout))
   {
     debug(PSTR("Utilization %l%%"), currentUtilization / 10000);
     currentUtilization = 0;
@@ -38,6 +38,12 @@
 #define WANT_BMP280 1
 #define WANT_SPL06  1
 
+#define WANT_FIXED_POINT_COMPENSATION 1 // The F103 has no FPU, see nano.h
+
+#define WANT_TASK_STATS 1 // Per task runtime histograms, see the 'T' command
+//#define WANT_PROFILING  1 // micros() resolution only, see the 'P' command
+//#define WANT_TRACE      1 // Event trace ring buffer, see the 'X' command
+
 #define MAX_ANALOG 4096
 #define MAX_PWM 65536
 
@@ -0,0 +1,680 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+
+   Author: Steven.Carr@hammontonmakers.org
+*/
+
+
+#include "config.h"
+
+// Asynchronous bus transactions, see busdevice.h
+//
+// On the Teensy 4.0 the LPI2C peripherals that Wire and Wire1 have already set up are driven
+// from their interrupts: each transaction is turned into a short list of FIFO commands
+// (mux select, start, register, repeated start, receive, stop) that the interrupt keeps
+// topped up, and received bytes are copied out as they arrive.  The interrupt is only enabled
+// while we own the bus, so the Wire library's own polling is never disturbed; anything that
+// uses a Wire directly must call busAsyncWaitIdle() first (busReadBuf() etc. already do).
+// SPI transactions are a single DMA transfer each, finished off from the EventResponder.
+
+#define BUS_TXN_TIMEOUT_MICROS 5000 // Longest a transaction may take before we give up on the bus
+
+static bool busRunBlocking(busTransaction_t *txn)
+{
+  bool ok;
+
+  if (txn->isRead)
+    ok = busReadBuf(txn->busDev, txn->reg, txn->buffer, txn->length);
+  else
+    ok = busWriteBuf(txn->busDev, txn->reg, txn->buffer, txn->length);
+  txn->finishedMicros = micros();
+  txn->state = (ok ? BUS_TXN_DONE : BUS_TXN_FAILED);
+  if (txn->callback)
+    txn->callback(txn);
+  return true;
+}
+
+#ifdef WANT_ASYNC_I2C
+
+#define BUS_ASYNC_PRIORITY 96 // Above the control tick (CONTROL_TICK_PRIORITY), it waits on us
+#define LPI2C_FIFO_SIZE    4
+#define LPI2C_ERRORS       (LPI2C_MSR_NDF | LPI2C_MSR_ALF | LPI2C_MSR_FEF | LPI2C_MSR_PLTF)
+#define LPI2C_INTERRUPTS   (LPI2C_MIER_TDIE | LPI2C_MIER_RDIE | LPI2C_MIER_SDIE | LPI2C_MIER_NDIE | LPI2C_MIER_ALIE | LPI2C_MIER_FEIE | LPI2C_MIER_PLTIE)
+
+// The commands that make up a transaction, in the order they go into the transmit FIFO
+typedef enum {
+  STEP_MUX_START = 0,
+  STEP_MUX_CHANNEL,
+  STEP_MUX_STOP,    // The mux only switches on a stop
+  STEP_START,
+  STEP_REGISTER_HIGH, // EEPROMs only
+  STEP_REGISTER,
+  STEP_DATA,        // Writes, once per byte
+  STEP_RESTART,     // Reads, repeated start with the read bit set
+  STEP_RECEIVE,
+  STEP_STOP,
+  STEP_DONE
+} busAsyncStep_e;
+
+typedef struct busAsyncPort_s {
+  TwoWire *wire;
+  IMXRT_LPI2C_t *lpi2c;
+  IRQ_NUMBER_t irq;
+  busTransaction_t *head; // The one on the bus
+  busTransaction_t *tail;
+  uint8_t step;
+  uint8_t txPos;
+  uint8_t rxPos;
+  uint8_t stopsPending;
+  bool recovering;        // Waiting for the stop we sent after an error
+} busAsyncPort_t;
+
+// Teensy 4.0: Wire is LPI2C1, Wire1 is LPI2C3
+static busAsyncPort_t busAsyncPorts[] = {
+  { &Wire,  &IMXRT_LPI2C1, IRQ_LPI2C1 },
+  { &Wire1, &IMXRT_LPI2C3, IRQ_LPI2C3 }
+};
+#define BUS_ASYNC_PORTS (sizeof(busAsyncPorts) / sizeof(busAsyncPort_t))
+
+static busAsyncPort_t *busAsyncPortFor(TwoWire *wire)
+{
+  for (uint8_t x = 0; x < BUS_ASYNC_PORTS; x++)
+    if (busAsyncPorts[x].wire == wire)
+      return &busAsyncPorts[x];
+  return NULL;
+}
+
+static void busAsyncStart(busAsyncPort_t *port)
+{
+  busTransaction_t *txn = port->head;
+  busDevice_t *busDev = txn->busDev;
+  busDevice_t *mux = busDev->busdev.i2c.channelDev;
+
+  txn->state = BUS_TXN_ACTIVE;
+  port->txPos = 0;
+  port->rxPos = 0;
+  port->step = STEP_START;
+  port->stopsPending = 1;
+
+  if (mux && busDev->busdev.i2c.channel && mux->currentChannel != busDev->busdev.i2c.channel)
+  {
+    mux->currentChannel = busDev->busdev.i2c.channel;
+    busStats.muxSwitches++;
+    port->step = STEP_MUX_START;
+    port->stopsPending = 2;
+  }
+
+  TRACE(TRACE_I2C_START, busTraceArg(busDev), txn->reg);
+  busDev->enableCbk(busDev, true);
+  port->lpi2c->MSR = LPI2C_MSR_SDF | LPI2C_ERRORS;
+  port->lpi2c->MIER = LPI2C_INTERRUPTS; // The empty transmit FIFO gets us going
+}
+
+static void busAsyncFinish(busAsyncPort_t *port, uint8_t state)
+{
+  busTransaction_t *txn = port->head;
+
+  port->lpi2c->MIER = (port->recovering ? (LPI2C_MIER_SDIE | LPI2C_ERRORS) : 0);
+  txn->busDev->enableCbk(txn->busDev, false);
+  TRACE(TRACE_I2C_END, busTraceArg(txn->busDev), state == BUS_TXN_FAILED);
+  busCountTransaction(txn->busDev, state == BUS_TXN_DONE);
+
+  port->head = txn->next;
+  if (port->head == NULL)
+    port->tail = NULL;
+  txn->next = NULL;
+  txn->finishedMicros = micros();
+  txn->state = state;
+  if (txn->callback)
+    txn->callback(txn);
+
+  if (port->head && !port->recovering)
+    busAsyncStart(port);
+}
+
+// Next word for the transmit FIFO, false once the whole transaction has been handed over
+static bool busAsyncNextCommand(busAsyncPort_t *port, uint32_t *command)
+{
+  busTransaction_t *txn = port->head;
+  busDevice_t *busDev = txn->busDev;
+  uint8_t address = busDev->busdev.i2c.address;
+
+  switch (port->step)
+  {
+    case STEP_MUX_START:
+      *command = LPI2C_MTDR_CMD_START | LPI2C_MTDR_DATA(busDev->busdev.i2c.channelDev->busdev.i2c.address << 1);
+      port->step = STEP_MUX_CHANNEL;
+      return true;
+    case STEP_MUX_CHANNEL:
+      *command = LPI2C_MTDR_CMD_TRANSMIT | LPI2C_MTDR_DATA(busDev->busdev.i2c.channel);
+      port->step = STEP_MUX_STOP;
+      return true;
+    case STEP_MUX_STOP:
+      *command = LPI2C_MTDR_CMD_STOP;
+      port->step = STEP_START;
+      return true;
+    case STEP_START:
+      *command = LPI2C_MTDR_CMD_START | LPI2C_MTDR_DATA(address << 1);
+      port->step = (busDev->hwType == HWTYPE_EEPROM ? STEP_REGISTER_HIGH : STEP_REGISTER);
+      return true;
+    case STEP_REGISTER_HIGH:
+      *command = LPI2C_MTDR_CMD_TRANSMIT | LPI2C_MTDR_DATA(txn->reg >> 8);
+      port->step = STEP_REGISTER;
+      return true;
+    case STEP_REGISTER:
+      *command = LPI2C_MTDR_CMD_TRANSMIT | LPI2C_MTDR_DATA(txn->reg & 0xFF);
+      port->step = (txn->isRead ? STEP_RESTART : (txn->length ? STEP_DATA : STEP_STOP));
+      return true;
+    case STEP_DATA:
+      *command = LPI2C_MTDR_CMD_TRANSMIT | LPI2C_MTDR_DATA(txn->buffer[port->txPos++]);
+      if (port->txPos == txn->length)
+        port->step = STEP_STOP;
+      return true;
+    case STEP_RESTART:
+      *command = LPI2C_MTDR_CMD_START | LPI2C_MTDR_DATA((address << 1) | 1);
+      port->step = STEP_RECEIVE;
+      return true;
+    case STEP_RECEIVE:
+      *command = LPI2C_MTDR_CMD_RECEIVE | LPI2C_MTDR_DATA(txn->length - 1);
+      port->step = STEP_STOP;
+      return true;
+    case STEP_STOP:
+      *command = LPI2C_MTDR_CMD_STOP;
+      port->step = STEP_DONE;
+      return true;
+  }
+  return false;
+}
+
+static void busAsyncService(busAsyncPort_t *port)
+{
+  IMXRT_LPI2C_t *lpi2c = port->lpi2c;
+  busTransaction_t *txn = port->head;
+  uint32_t status = lpi2c->MSR;
+  uint32_t command;
+
+  if (port->recovering)
+  {
+    lpi2c->MSR = status & (LPI2C_MSR_SDF | LPI2C_ERRORS);
+    if (status & (LPI2C_MSR_SDF | LPI2C_ERRORS))
+    {
+      port->recovering = false;
+      lpi2c->MIER = 0;
+      if (port->head)
+        busAsyncStart(port);
+    }
+    return;
+  }
+
+  if (txn == NULL)
+  {
+    lpi2c->MIER = 0;
+    return;
+  }
+
+  while (txn->isRead)
+  {
+    uint32_t data = lpi2c->MRDR;
+    if (data & LPI2C_MRDR_RXEMPTY)
+      break;
+    if (port->rxPos < txn->length)
+      txn->buffer[port->rxPos++] = data & 0xFF;
+  }
+
+  if (status & LPI2C_ERRORS)
+  {
+    lpi2c->MSR = status & LPI2C_ERRORS;
+    lpi2c->MCR |= LPI2C_MCR_RTF | LPI2C_MCR_RRF; // Throw away the rest of this transaction
+    // We do not know if the mux switched
+    if (txn->busDev->busdev.i2c.channelDev)
+      txn->busDev->busdev.i2c.channelDev->currentChannel = 0;
+    // After losing arbitration the bus is not ours to stop
+    if (!(status & LPI2C_MSR_ALF))
+    {
+      lpi2c->MTDR = LPI2C_MTDR_CMD_STOP;
+      port->recovering = true;
+    }
+    busAsyncFinish(port, BUS_TXN_FAILED);
+    return;
+  }
+
+  if (status & LPI2C_MSR_SDF)
+  {
+    lpi2c->MSR = LPI2C_MSR_SDF;
+    if (port->stopsPending && --port->stopsPending == 0)
+    {
+      busAsyncFinish(port, (!txn->isRead || port->rxPos == txn->length) ? BUS_TXN_DONE : BUS_TXN_FAILED);
+      return;
+    }
+  }
+
+  // Keep the transmit FIFO topped up
+  while ((lpi2c->MFSR & 0x07) < LPI2C_FIFO_SIZE && busAsyncNextCommand(port, &command))
+    lpi2c->MTDR = command;
+  if (port->step == STEP_DONE)
+    lpi2c->MIER &= ~LPI2C_MIER_TDIE;
+}
+
+static void busAsyncIsr0()
+{
+  busAsyncService(&busAsyncPorts[0]);
+}
+
+static void busAsyncIsr1()
+{
+  busAsyncService(&busAsyncPorts[1]);
+}
+
+static void busI2cInit()
+{
+  attachInterruptVector(busAsyncPorts[0].irq, busAsyncIsr0);
+  attachInterruptVector(busAsyncPorts[1].irq, busAsyncIsr1);
+  for (uint8_t x = 0; x < BUS_ASYNC_PORTS; x++)
+  {
+    busAsyncPorts[x].lpi2c->MIER = 0;
+    NVIC_SET_PRIORITY(busAsyncPorts[x].irq, BUS_ASYNC_PRIORITY);
+    NVIC_ENABLE_IRQ(busAsyncPorts[x].irq);
+  }
+}
+
+// The bus has wedged, fail everything that is queued on it so nobody waits forever
+static void busAsyncAbort(busAsyncPort_t *port)
+{
+  IMXRT_LPI2C_t *lpi2c = port->lpi2c;
+  busTransaction_t *txn;
+
+  noInterrupts();
+  lpi2c->MIER = 0;
+  txn = port->head;
+  if (txn && txn->state == BUS_TXN_ACTIVE)
+  {
+    txn->busDev->enableCbk(txn->busDev, false);
+    TRACE(TRACE_I2C_END, busTraceArg(txn->busDev), 1);
+    busCountTransaction(txn->busDev, false);
+  }
+
+  // Reset the master so it lets go of the bus, the reset clears everything but MCR, so put
+  // back the timing and FIFO setup the Wire library gave it
+  uint32_t mcfgr0 = lpi2c->MCFGR0, mcfgr1 = lpi2c->MCFGR1, mcfgr2 = lpi2c->MCFGR2, mcfgr3 = lpi2c->MCFGR3;
+  uint32_t mccr0 = lpi2c->MCCR0, mccr1 = lpi2c->MCCR1, mfcr = lpi2c->MFCR, mcr = lpi2c->MCR;
+  lpi2c->MCR = LPI2C_MCR_RST;
+  lpi2c->MCR = 0;
+  lpi2c->MCFGR0 = mcfgr0;
+  lpi2c->MCFGR1 = mcfgr1;
+  lpi2c->MCFGR2 = mcfgr2;
+  lpi2c->MCFGR3 = mcfgr3;
+  lpi2c->MCCR0 = mccr0;
+  lpi2c->MCCR1 = mccr1;
+  lpi2c->MFCR = mfcr;
+  lpi2c->MCR = mcr & ~(LPI2C_MCR_RST | LPI2C_MCR_RTF | LPI2C_MCR_RRF);
+  lpi2c->MSR = LPI2C_MSR_SDF | LPI2C_ERRORS;
+  port->recovering = false;
+
+  // Take the whole queue off the port, the callbacks may queue again
+  port->head = NULL;
+  port->tail = NULL;
+  interrupts();
+
+  while (txn)
+  {
+    busTransaction_t *next = txn->next;
+    if (txn->busDev->busdev.i2c.channelDev)
+      txn->busDev->busdev.i2c.channelDev->currentChannel = 0;
+    txn->next = NULL;
+    txn->finishedMicros = micros();
+    txn->state = BUS_TXN_FAILED;
+    if (txn->callback)
+      txn->callback(txn);
+    txn = next;
+  }
+}
+
+static bool busI2cQueue(busTransaction_t *txn)
+{
+  busAsyncPort_t *port = busAsyncPortFor(txn->busDev->busdev.i2c.i2cBus);
+
+  if (port == NULL)
+    return busRunBlocking(txn);
+
+  txn->state = BUS_TXN_QUEUED;
+  txn->next = NULL;
+
+  noInterrupts();
+  if (port->tail)
+    port->tail->next = txn;
+  else
+    port->head = txn;
+  port->tail = txn;
+  if (port->head == txn && !port->recovering)
+    busAsyncStart(port);
+  interrupts();
+  return true;
+}
+
+static void busI2cAbort(busDevice_t *busDev)
+{
+  busAsyncPort_t *port = busAsyncPortFor(busDev->busdev.i2c.i2cBus);
+
+  if (port)
+    busAsyncAbort(port);
+}
+
+void busAsyncWaitIdle(TwoWire *wire)
+{
+  busAsyncPort_t *port = busAsyncPortFor(wire);
+  unsigned long start = micros();
+
+  if (port == NULL)
+    return;
+  while (port->head || port->recovering)
+  {
+    if (micros() - start > BUS_TXN_TIMEOUT_MICROS * 4)
+    {
+      busAsyncAbort(port);
+      break;
+    }
+  }
+}
+
+#else
+
+static void busI2cInit()
+{
+}
+
+static bool busI2cQueue(busTransaction_t *txn)
+{
+  return busRunBlocking(txn);
+}
+
+static void busI2cAbort(busDevice_t *busDev)
+{
+}
+
+void busAsyncWaitIdle(TwoWire *wire)
+{
+}
+#endif
+
+#ifdef WANT_ASYNC_SPI
+
+// A transaction is one DMA transfer of the register, any dummy bytes and the data.  The
+// receive buffer is cache line aligned, the SPI library invalidates it after the transfer.
+#define BUS_SPI_FRAME_MAX 64
+
+typedef struct busSpiPort_s {
+  SPIClass *spi;
+  EventResponder event;
+  busTransaction_t *head; // The one on the bus
+  busTransaction_t *tail;
+  uint8_t skip;           // Bytes in rx[] before the data
+  uint8_t tx[BUS_SPI_FRAME_MAX];
+  uint8_t rx[BUS_SPI_FRAME_MAX] __attribute__((aligned(32)));
+} busSpiPort_t;
+
+static busSpiPort_t busSpiPorts[] = {
+  { &SPI }
+};
+#define BUS_SPI_PORTS (sizeof(busSpiPorts) / sizeof(busSpiPort_t))
+
+static busSpiPort_t *busSpiPortFor(SPIClass *spi)
+{
+  for (uint8_t x = 0; x < BUS_SPI_PORTS; x++)
+    if (busSpiPorts[x].spi == spi)
+      return &busSpiPorts[x];
+  return NULL;
+}
+
+static void busSpiStart(busSpiPort_t *port)
+{
+  busTransaction_t *txn = port->head;
+  busDevice_t *busDev = txn->busDev;
+  uint8_t length;
+
+  txn->state = BUS_TXN_ACTIVE;
+  if (txn->isRead)
+  {
+    port->tx[0] = txn->reg | 0x80;
+    port->skip = 1 + busDev->busdev.spi.readDummy;
+    length = port->skip + txn->length;
+    memset(&port->tx[1], 0, length - 1);
+  }
+  else
+  {
+    port->tx[0] = txn->reg & 0x7F;
+    port->skip = 1;
+    length = 1 + txn->length;
+    memcpy(&port->tx[1], txn->buffer, txn->length);
+  }
+
+  TRACE(TRACE_I2C_START, busTraceArg(busDev), txn->reg);
+  port->spi->beginTransaction(SPISettings(BUS_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  busDev->enableCbk(busDev, true);
+  port->spi->transfer(port->tx, port->rx, length, port->event);
+}
+
+static void busSpiDone(EventResponder &event)
+{
+  busSpiPort_t *port = (busSpiPort_t *)event.getContext();
+  busTransaction_t *txn = port->head;
+
+  txn->busDev->enableCbk(txn->busDev, false);
+  port->spi->endTransaction();
+  TRACE(TRACE_I2C_END, busTraceArg(txn->busDev), 0);
+  if (txn->isRead)
+    memcpy(txn->buffer, &port->rx[port->skip], txn->length);
+
+  port->head = txn->next;
+  if (port->head == NULL)
+    port->tail = NULL;
+  txn->next = NULL;
+  txn->finishedMicros = micros();
+  txn->state = BUS_TXN_DONE; // No acknowledge on SPI
+  busCountTransaction(txn->busDev, true);
+  if (txn->callback)
+    txn->callback(txn);
+
+  if (port->head)
+    busSpiStart(port);
+}
+
+static void busSpiInit()
+{
+  for (uint8_t x = 0; x < BUS_SPI_PORTS; x++)
+  {
+    busSpiPorts[x].event.setContext(&busSpiPorts[x]);
+    busSpiPorts[x].event.attachImmediate(busSpiDone);
+  }
+}
+
+static bool busSpiQueue(busTransaction_t *txn)
+{
+  busSpiPort_t *port = busSpiPortFor(txn->busDev->busdev.spi.spiBus);
+
+  if (port == NULL || 1 + txn->busDev->busdev.spi.readDummy + txn->length > BUS_SPI_FRAME_MAX)
+    return busRunBlocking(txn);
+
+  txn->state = BUS_TXN_QUEUED;
+  txn->next = NULL;
+
+  noInterrupts();
+  if (port->tail)
+    port->tail->next = txn;
+  else
+    port->head = txn;
+  port->tail = txn;
+  if (port->head == txn)
+    busSpiStart(port);
+  interrupts();
+  return true;
+}
+
+// The clock is ours, so a transfer cannot really hang; this is here for symmetry with I2C
+static void busSpiAbort(busDevice_t *busDev)
+{
+  busSpiPort_t *port = busSpiPortFor(busDev->busdev.spi.spiBus);
+
+  if (port == NULL)
+    return;
+  noInterrupts();
+  busTransaction_t *txn = port->head;
+  if (txn)
+  {
+    txn->busDev->enableCbk(txn->busDev, false);
+    port->spi->endTransaction();
+    TRACE(TRACE_I2C_END, busTraceArg(txn->busDev), 1);
+    busCountTransaction(txn->busDev, false);
+  }
+  port->head = NULL;
+  port->tail = NULL;
+  interrupts();
+
+  // As busAsyncAbort()
+  while (txn)
+  {
+    busTransaction_t *next = txn->next;
+    txn->next = NULL;
+    txn->finishedMicros = micros();
+    txn->state = BUS_TXN_FAILED;
+    if (txn->callback)
+      txn->callback(txn);
+    txn = next;
+  }
+}
+
+void busAsyncWaitIdle(SPIClass *spi)
+{
+  busSpiPort_t *port = busSpiPortFor(spi);
+  unsigned long start = micros();
+
+  if (port == NULL)
+    return;
+  while (port->head)
+  {
+    if (micros() - start > BUS_TXN_TIMEOUT_MICROS * 4)
+    {
+      busSpiAbort(port->head->busDev);
+      break;
+    }
+  }
+}
+
+#else
+
+static void busSpiInit()
+{
+}
+
+static bool busSpiQueue(busTransaction_t *txn)
+{
+  return busRunBlocking(txn);
+}
+
+static void busSpiAbort(busDevice_t *busDev)
+{
+}
+
+void busAsyncWaitIdle(SPIClass *spi)
+{
+}
+#endif
+
+void busAsyncInit()
+{
+  busI2cInit();
+  busSpiInit();
+}
+
+static bool busAsyncQueue(busTransaction_t *txn)
+{
+  if (txn->busDev->busType == BUSTYPE_SPI)
+    return busSpiQueue(txn);
+  return busI2cQueue(txn);
+}
+
+bool busTransactionWait(busTransaction_t *txn)
+{
+  unsigned long start = micros();
+
+  while (!busTransactionFinished(txn))
+  {
+    if (micros() - start > BUS_TXN_TIMEOUT_MICROS)
+    {
+      if (txn->busDev->busType == BUSTYPE_SPI)
+        busSpiAbort(txn->busDev);
+      else
+        busI2cAbort(txn->busDev);
+      break;
+    }
+  }
+  return txn->state == BUS_TXN_DONE;
+}
+
+bool busReadBufAsync(busTransaction_t *txn, busDevice_t *busDev, unsigned short reg, uint8_t *values, uint8_t length, busTransactionCbk callback)
+{
+  txn->busDev = busDev;
+  txn->reg = reg;
+  txn->buffer = values;
+  txn->length = length;
+  txn->isRead = true;
+  txn->callback = callback;
+  txn->state = BUS_TXN_FAILED;
+  if (busDev == NULL || busDev->busType == BUSTYPE_NONE || length == 0)
+    return false;
+  return busAsyncQueue(txn);
+}
+
+bool busWriteBufAsync(busTransaction_t *txn, busDevice_t *busDev, unsigned short reg, uint8_t *values, uint8_t length, busTransactionCbk callback)
+{
+  txn->busDev = busDev;
+  txn->reg = reg;
+  txn->buffer = values;
+  txn->length = length;
+  txn->isRead = false;
+  txn->callback = callback;
+  txn->state = BUS_TXN_FAILED;
+  if (busDev == NULL || busDev->busType == BUSTYPE_NONE)
+    return false;
+  return busAsyncQueue(txn);
+}
+
+#define BUS_RETRY_BACKOFF_MICROS 50 // Before the first retry, it doubles for each one after that
+
+// Wait for a transaction, and put it back on the bus (up to retries times) if it failed.
+// A glitch on the VISP cable then costs a few hundred microseconds instead of a re-detection.
+bool busTransactionWaitRetry(busTransaction_t *txn, uint8_t retries)
+{
+  busDeviceStats_t *stats;
+
+  if (txn->busDev == NULL)
+    return false;
+  stats = &busDeviceStats[txn->busDev - devices];
+
+  for (uint8_t attempt = 0; !busTransactionWait(txn); attempt++)
+  {
+    if (attempt == retries)
+    {
+      if (stats->failures != 0xFFFF)
+        stats->failures++;
+      return false;
+    }
+    if (stats->retries != 0xFFFF)
+      stats->retries++;
+    delayMicroseconds(BUS_RETRY_BACKOFF_MICROS << attempt);
+    busAsyncQueue(txn);
+  }
+  return true;
+}
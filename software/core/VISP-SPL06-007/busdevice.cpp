@@ -22,10 +22,43 @@
 // Get rid of malloc() and free() issues
 busDevice_t devices[DEVICE_MAX];
 
+// Non-zero while a transaction is on the wire, the control tick must not start one of its own
+volatile uint8_t busInUse = 0;
+
+busStats_t busStats;
+busDeviceStats_t busDeviceStats[DEVICE_MAX];
+
+#ifndef I2C_CLOCK_MAX
+#define I2C_CLOCK_MAX 400000
+#endif
+
+#define BUS_CLOCK_DEFAULT  1   // 400KHz
+#define BUS_VERIFY_READS   4   // Reads of each device's verify block at a new clock
+#define BUS_ERROR_WINDOW   256 // Transactions
+#define BUS_ERROR_LIMIT    3   // More errors than this in a window steps the clock down
+
+const unsigned long busClockSteps[] PUTINFLASH = { 100000, 400000, 1000000 };
+#define BUS_CLOCK_STEPS (sizeof(busClockSteps) / sizeof(unsigned long))
+
+typedef struct busClock_s {
+  TwoWire *wire;
+  uint8_t step;              // Into busClockSteps[]
+  uint8_t maxStep;           // Lowered when the bus turns out to be marginal
+  bool stepDownPending;      // Applied by busStatsSample(), when the bus is quiet
+  uint16_t windowTransactions;
+  uint16_t windowErrors;
+  unsigned long transactions;
+  unsigned long errors;
+  uint16_t stepDowns;
+} busClock_t;
+
+static busClock_t busClocks[BUS_CLOCK_MAX];
+
 
 void busDeviceInit()
 {
   memset(&devices, 0, sizeof(devices));
+  busAsyncInit();
 }
 
 // Channel is the channel value for the mux chip
@@ -40,6 +73,7 @@ static uint8_t muxSelectChannel(busDevice_t *busDev, uint8_t channel)
       busDev->busdev.i2c.i2cBus->write(channel);
       error = busDev->busdev.i2c.i2cBus->endTransmission();
       busDev->currentChannel = channel;
+      busStats.muxSwitches++;
       return error;
     }
     return 0;
@@ -59,11 +93,11 @@ void busPrint(busDevice_t *bus, const char *function)
     debug(PSTR("%S(I2C: bus=0x%x a=0x%x ch=%d)"), function, bus->busdev.i2c.i2cBus, bus->busdev.i2c.address, bus->busdev.i2c.channel);
     return;
   }
-  //  if (bus->busType == BUSTYPE_SPI)
-  //  {
-  //    debug(PSTR("%S(SPI)"), function);
-  //    return;
-  //  }
+  if (bus->busType == BUSTYPE_SPI)
+  {
+    debug(PSTR("%S(SPI: cs=%d)"), function, bus->busdev.spi.csPin);
+    return;
+  }
 }
 
 void noEnableCbk(busDevice_t *busDevice, bool enableFlag)
@@ -85,7 +119,13 @@ busDevice_t *busDeviceInitI2C(uint8_t devNum, TwoWire *wire, uint8_t address, ui
   return dev;
 }
 
-busDevice_t *busDeviceInitSPI(uint8_t devNum, SPIClass *spiBus, busDeviceEnableCbk enableCbk, hwType_e hwType)
+// Chip select is active low
+void spiChipSelectCbk(busDevice_t *busDevice, bool enableFlag)
+{
+  digitalWrite(busDevice->busdev.spi.csPin, (enableFlag ? LOW : HIGH));
+}
+
+busDevice_t *busDeviceInitSPI(uint8_t devNum, SPIClass *spiBus, uint8_t csPin, busDeviceEnableCbk enableCbk, hwType_e hwType)
 {
   busDevice_t *dev = &devices[devNum];
   memset(dev, 0, sizeof(busDevice_t));
@@ -93,9 +133,286 @@ busDevice_t *busDeviceInitSPI(uint8_t devNum, SPIClass *spiBus, busDeviceEnableC
   dev->hwType = hwType;
   dev->enableCbk = enableCbk;
   dev->busdev.spi.spiBus = spiBus;
+  dev->busdev.spi.csPin = csPin;
+  pinMode(csPin, OUTPUT);
+  enableCbk(dev, false);
   return dev;
 }
 
+// Order to visit a set of devices in that keeps the mux switching down: everything on the
+// channel the mux is already on goes first, then the rest grouped by channel.  Devices that
+// are not behind a mux keep their place.  order[] gets the indexes into devs[].
+void busDeviceVisitOrder(busDevice_t * const *devs, uint8_t count, uint8_t *order)
+{
+  uint8_t key[DEVICE_MAX]; // count is never more than DEVICE_MAX
+
+  for (uint8_t x = 0; x < count; x++)
+  {
+    bool isI2C = (devs[x] && devs[x]->busType == BUSTYPE_I2C);
+    busDevice_t *mux = (isI2C ? devs[x]->busdev.i2c.channelDev : NULL);
+    uint8_t channel = (isI2C ? devs[x]->busdev.i2c.channel : 0);
+
+    key[x] = ((mux == NULL || channel == mux->currentChannel) ? 0 : channel);
+    order[x] = x;
+  }
+
+  // Insertion sort, it is stable and count is tiny
+  for (uint8_t x = 1; x < count; x++)
+  {
+    uint8_t current = order[x];
+    int8_t y = x - 1;
+    for (; y >= 0 && key[order[y]] > key[current]; y--)
+      order[y + 1] = order[y];
+    order[y + 1] = current;
+  }
+}
+
+static busClock_t *busClockFor(TwoWire *wire)
+{
+  for (uint8_t x = 0; x < BUS_CLOCK_MAX; x++)
+    if (wire && busClocks[x].wire == wire)
+      return &busClocks[x];
+  return NULL;
+}
+
+static unsigned long busClockStepHz(uint8_t step)
+{
+  return pgm_read_dword(&busClockSteps[step]);
+}
+
+static void busClockSet(busClock_t *clock, uint8_t step)
+{
+  busAsyncWaitIdle(clock->wire);
+  clock->step = step;
+  clock->wire->setClock(busClockStepHz(step));
+}
+
+void busClockInit(TwoWire *wire)
+{
+  for (uint8_t x = 0; wire && x < BUS_CLOCK_MAX; x++)
+  {
+    if (busClocks[x].wire == NULL)
+    {
+      busClock_t *clock = &busClocks[x];
+      clock->wire = wire;
+      clock->maxStep = 0;
+      while (clock->maxStep < BUS_CLOCK_STEPS - 1 && busClockStepHz(clock->maxStep + 1) <= I2C_CLOCK_MAX)
+        clock->maxStep++;
+      busClockSet(clock, BUS_CLOCK_DEFAULT);
+      return;
+    }
+  }
+}
+
+// For devices that busClockNegotiate() cannot read back (the displays), the bus never goes
+// faster than hz from now on
+void busClockLimit(TwoWire *wire, unsigned long hz)
+{
+  busClock_t *clock = busClockFor(wire);
+
+  if (clock == NULL)
+    return;
+  while (clock->maxStep > 0 && busClockStepHz(clock->maxStep) > hz)
+    clock->maxStep--;
+  if (clock->step > clock->maxStep)
+    busClockSet(clock, clock->maxStep);
+}
+
+// Back to 400KHz, to look for a VISP that may not be the one we negotiated with
+void busClockReset(TwoWire *wire)
+{
+  busClock_t *clock = busClockFor(wire);
+
+  if (clock && clock->step != BUS_CLOCK_DEFAULT)
+    busClockSet(clock, BUS_CLOCK_DEFAULT);
+}
+
+// CRC-8 (poly 0x31) of a device's verify block
+static uint8_t busVerifyCrc(busDevice_t *busDev, bool *ok)
+{
+  uint8_t buffer[32];
+  uint8_t crc = 0xFF;
+  uint8_t length = (busDev->verifyLength > sizeof(buffer) ? sizeof(buffer) : busDev->verifyLength);
+
+  *ok = busReadBuf(busDev, busDev->verifyReg, buffer, length);
+  for (uint8_t x = 0; x < length; x++)
+  {
+    crc ^= buffer[x];
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1);
+  }
+  return crc;
+}
+
+// Call after detection, at the default clock.  Works up the clock steps, reading back every
+// device on the bus that has a verify block, and settles on the fastest one that matched.
+uint8_t busClockNegotiate(TwoWire *wire)
+{
+  busClock_t *clock = busClockFor(wire);
+  uint8_t reference[DEVICE_MAX];
+  uint8_t checked = 0;
+  bool ok;
+
+  if (clock == NULL)
+    return 0;
+
+  for (uint8_t x = 0; x < DEVICE_MAX; x++)
+  {
+    busDevice_t *busDev = &devices[x];
+    if (busDev->busType == BUSTYPE_I2C && busDev->busdev.i2c.i2cBus == wire && busDev->verifyLength)
+    {
+      reference[x] = busVerifyCrc(busDev, &ok);
+      if (!ok)
+        return 0; // Not a good time to be changing clocks
+      checked++;
+    }
+  }
+  if (checked == 0)
+    return 0;
+
+  while (clock->step < clock->maxStep)
+  {
+    uint8_t lastGood = clock->step;
+
+    busClockSet(clock, lastGood + 1);
+    for (uint8_t x = 0; ok && x < DEVICE_MAX; x++)
+    {
+      busDevice_t *busDev = &devices[x];
+      if (busDev->busType == BUSTYPE_I2C && busDev->busdev.i2c.i2cBus == wire && busDev->verifyLength)
+        for (uint8_t y = 0; ok && y < BUS_VERIFY_READS; y++)
+        {
+          bool ack;
+          uint8_t crc = busVerifyCrc(busDev, &ack);
+          ok = (ack && crc == reference[x]);
+        }
+    }
+    if (!ok)
+    {
+      warning(PSTR("I2C readback failed at %lHz"), (long)busClockStepHz(clock->step));
+      busClockSet(clock, lastGood);
+      break;
+    }
+  }
+  info(PSTR("I2C bus running at %lHz"), (long)busClockStepHz(clock->step));
+  return checked;
+}
+
+unsigned long busClockHz(uint8_t bus)
+{
+  if (bus >= BUS_CLOCK_MAX || busClocks[bus].wire == NULL)
+    return 0;
+  return busClockStepHz(busClocks[bus].step);
+}
+
+#ifdef WANT_TRACE
+// Both I2C buses can be busy at once, the bus lets the trace decoder keep them apart
+uint8_t busTraceArg(busDevice_t *busDev)
+{
+  uint8_t bus = BUS_TRACE_SPI;
+
+  if (busDev->busType == BUSTYPE_I2C)
+  {
+    busClock_t *clock = busClockFor(busDev->busdev.i2c.i2cBus);
+    bus = (clock ? clock - busClocks + 1 : 0);
+  }
+  return (bus << 4) | (busDev - devices);
+}
+#endif
+
+// Too many errors in a window and the bus gets stepped down a clock (by busStatsSample()).
+// Probing for devices that may not be there is not counted, only devices that were found.
+void busCountTransaction(busDevice_t *busDev, bool ok)
+{
+  busDeviceStats_t *stats = &busDeviceStats[busDev - devices];
+  busClock_t *clock = (busDev->busType == BUSTYPE_I2C ? busClockFor(busDev->busdev.i2c.i2cBus) : NULL);
+
+  if (busDev->hwType == HWTYPE_NONE)
+    return;
+
+  stats->transactions++;
+  if (!ok && stats->errors != 0xFFFF)
+    stats->errors++;
+
+  if (clock == NULL)
+    return;
+  clock->transactions++;
+  clock->windowTransactions++;
+  if (!ok)
+  {
+    clock->errors++;
+    if (++clock->windowErrors > BUS_ERROR_LIMIT && clock->step > 0)
+    {
+      clock->stepDownPending = true;
+      clock->windowErrors = 0;
+      clock->windowTransactions = 0;
+    }
+  }
+  if (clock->windowTransactions >= BUS_ERROR_WINDOW)
+  {
+    clock->windowErrors = 0;
+    clock->windowTransactions = 0;
+  }
+}
+
+// Call once per sensor sample, works out the mux switches it took.
+// The buses are quiet at this point, so this is also where clocks are stepped down.
+void busStatsSample()
+{
+  for (uint8_t x = 0; x < BUS_CLOCK_MAX; x++)
+  {
+    busClock_t *clock = &busClocks[x];
+    if (clock->stepDownPending)
+    {
+      clock->stepDownPending = false;
+      if (clock->step > 0)
+      {
+        clock->maxStep = clock->step - 1;
+        clock->stepDowns++;
+        busClockSet(clock, clock->maxStep);
+      }
+    }
+  }
+
+  unsigned long switches = busStats.muxSwitches - busStats.lastMuxSwitches;
+
+  busStats.lastMuxSwitches = busStats.muxSwitches;
+  busStats.sampleMuxSwitches = (switches > 255 ? 255 : switches);
+  if (busStats.sampleMuxSwitches > busStats.maxSampleMuxSwitches)
+    busStats.maxSampleMuxSwitches = busStats.sampleMuxSwitches;
+  busStats.samples++;
+}
+
+void busStatsReport()
+{
+  respond('B', PSTR("mux,%l,%l,%d,%d"), (long)busStats.muxSwitches, (long)busStats.samples,
+          busStats.sampleMuxSwitches, busStats.maxSampleMuxSwitches);
+  for (uint8_t x = 0; x < BUS_CLOCK_MAX; x++)
+  {
+    busClock_t *clock = &busClocks[x];
+    if (clock->wire)
+      respond('B', PSTR("bus,%d,%l,%l,%l,%l,%l"), x + 1, (long)busClockStepHz(clock->step), (long)busClockStepHz(clock->maxStep),
+              (long)clock->transactions, (long)clock->errors, (long)clock->stepDowns);
+  }
+  for (uint8_t x = 0; x < DEVICE_MAX; x++)
+  {
+    busDeviceStats_t *stats = &busDeviceStats[x];
+    if (stats->transactions)
+      respond('B', PSTR("dev,%d,%l,%l,%l,%l"), x, (long)stats->transactions, (long)stats->errors, (long)stats->retries, (long)stats->failures);
+  }
+}
+
+void busStatsClear()
+{
+  memset(&busStats, 0, sizeof(busStats));
+  memset(&busDeviceStats, 0, sizeof(busDeviceStats));
+  for (uint8_t x = 0; x < BUS_CLOCK_MAX; x++)
+  {
+    busClocks[x].transactions = 0;
+    busClocks[x].errors = 0;
+    busClocks[x].stepDowns = 0;
+  }
+}
+
 // Simply detect if the device is present on this device assignment
 bool busDeviceDetect(busDevice_t *busDev)
 {
@@ -105,6 +422,10 @@ bool busDeviceDetect(busDevice_t *busDev)
     uint8_t address = busDev->busdev.i2c.address;
     TwoWire *wire = busDev->busdev.i2c.i2cBus;
 
+    busAsyncWaitIdle(wire);
+    busInUse++;
+    TRACE(TRACE_I2C_START, busTraceArg(busDev), 0);
+
     // NANO uses NPN switches to enable/disable a bus for DUAL_I2C
     busDev->enableCbk(busDev, true);
     muxSelectChannel(busDev->busdev.i2c.channelDev, busDev->busdev.i2c.channel);
@@ -113,21 +434,64 @@ bool busDeviceDetect(busDevice_t *busDev)
     error = wire->endTransmission();
 
     busDev->enableCbk(busDev, false);
+    TRACE(TRACE_I2C_END, busTraceArg(busDev), error);
+    busInUse--;
 
     //busPrint(busDev, (error ? PSTR("MISSING...") : PSTR("DETECTED!!!")));
   }
   return (error == 0);
 }
 
+// The sensors all use the same SPI conventions: bit 7 of the register is set for a read and
+// clear for a write, and a read carries on through the following registers.
+static bool busSpiTransfer(busDevice_t *busDev, uint8_t reg, unsigned char *values, uint8_t length, bool isRead)
+{
+  SPIClass *spi = busDev->busdev.spi.spiBus;
+
+  busAsyncWaitIdle(spi);
+  busInUse++;
+  TRACE(TRACE_I2C_START, busTraceArg(busDev), reg);
+  spi->beginTransaction(SPISettings(BUS_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  busDev->enableCbk(busDev, true);
+
+  if (isRead)
+  {
+    spi->transfer(reg | 0x80);
+    for (uint8_t x = 0; x < busDev->busdev.spi.readDummy; x++)
+      spi->transfer(0);
+    for (uint8_t x = 0; x < length; x++)
+      values[x] = spi->transfer(0);
+  }
+  else
+  {
+    spi->transfer(reg & 0x7F);
+    for (uint8_t x = 0; x < length; x++)
+      spi->transfer(values[x]);
+  }
+
+  busDev->enableCbk(busDev, false);
+  spi->endTransaction();
+  TRACE(TRACE_I2C_END, busTraceArg(busDev), 0);
+  busInUse--;
+  busCountTransaction(busDev, true); // No acknowledge on SPI, it always "works"
+  return true;
+}
+
 bool busReadBuf(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length)
 {
   int error;
 
+  if (busDev && busDev->busType == BUSTYPE_SPI)
+    return busSpiTransfer(busDev, reg, values, length, true);
+
   if (busDev && busDev->busType == BUSTYPE_I2C)
   {
     uint8_t address = busDev->busdev.i2c.address;
     TwoWire *wire = busDev->busdev.i2c.i2cBus;
 
+    busAsyncWaitIdle(wire);
+    busInUse++;
+    TRACE(TRACE_I2C_START, busTraceArg(busDev), reg);
     busDev->enableCbk(busDev, true);
 
     muxSelectChannel(busDev->busdev.i2c.channelDev, busDev->busdev.i2c.channel);
@@ -140,8 +504,6 @@ bool busReadBuf(busDevice_t *busDev, unsigned short reg, unsigned char *values,
 
     if (0 == (error = wire->endTransmission()))
     {
-      if (busDev->hwType == HWTYPE_EEPROM)
-        delay(10);
       wire->requestFrom(address, length);
 
       while (wire->available() != length) ; // wait until bytes are ready
@@ -149,11 +511,17 @@ bool busReadBuf(busDevice_t *busDev, unsigned short reg, unsigned char *values,
         values[x] = wire->read();
 
       busDev->enableCbk(busDev, false);
+      TRACE(TRACE_I2C_END, busTraceArg(busDev), 0);
+      busInUse--;
+      busCountTransaction(busDev, true);
       return true;
     }
 
     //debug(PSTR("endTransmission() returned %s"), error);
     busDev->enableCbk(busDev, false);
+    TRACE(TRACE_I2C_END, busTraceArg(busDev), error);
+    busInUse--;
+    busCountTransaction(busDev, false);
     return false;
   }
   return false;
@@ -163,11 +531,17 @@ bool busWriteBuf(busDevice_t *busDev, unsigned short reg, unsigned char *values,
 {
   int error;
 
+  if (busDev && busDev->busType == BUSTYPE_SPI)
+    return busSpiTransfer(busDev, reg, values, length, false);
+
   if (busDev != NULL && busDev->busType == BUSTYPE_I2C)
   {
     int address = busDev->busdev.i2c.address;
     TwoWire *wire = busDev->busdev.i2c.i2cBus;
 
+    busAsyncWaitIdle(wire);
+    busInUse++;
+    TRACE(TRACE_I2C_START, busTraceArg(busDev), reg);
     busDev->enableCbk(busDev, true);
 
     muxSelectChannel(busDev->busdev.i2c.channelDev, busDev->busdev.i2c.channel);
@@ -178,22 +552,12 @@ bool busWriteBuf(busDevice_t *busDev, unsigned short reg, unsigned char *values,
     wire->write((uint8_t)(reg & 0xFF));
     wire->write(values, length);
     error = wire->endTransmission();
-
-    // EEPROM needs this...
-    if (busDev->hwType == HWTYPE_EEPROM && error == 0)
-    {
-      //wait up to 50ms for the write to complete
-      for (uint8_t i = 100; i; --i) {
-        delayMicroseconds(500);                     //no point in waiting too fast
-        wire->beginTransmission(address);
-        wire->write(0);        //high addr byte
-        wire->write(0);        //low addr byte
-        error = wire->endTransmission();
-        if (error == 0) break;
-      }
-    }
+    // The EEPROM write cycle is polled for by eepromService()
 
     busDev->enableCbk(busDev, false);
+    TRACE(TRACE_I2C_END, busTraceArg(busDev), error);
+    busInUse--;
+    busCountTransaction(busDev, error == 0);
 
     return (error == 0 ? true : false);
   }
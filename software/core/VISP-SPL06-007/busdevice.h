@@ -48,16 +48,22 @@ typedef enum {
 
 typedef void (*busDeviceEnableCbk)(struct busDevice_s *, bool enableFlag);
 
+#define BUS_SPI_CLOCK 10000000 // The BMP280, BMP388 and SPL06 all top out at 10MHz
+
 
 
 typedef struct busDevice_s {
   busType_e busType;
   hwType_e hwType;
   uint8_t currentChannel; // If this device is a HWTYPE_MUX
+  uint8_t verifyReg;      // A block of registers that never changes, read back to check a faster bus clock
+  uint8_t verifyLength;   // 0 if the device has nothing to check
   busDeviceEnableCbk enableCbk; // Used to set the appropriate enable pin for SPI peripherals or I2C bus switching
   union {
     struct {
       SPIClass *spiBus;       // SPI bus
+      uint8_t csPin;          // Chip select, driven by spiChipSelectCbk()
+      uint8_t readDummy;      // Bytes the device sends between the register and the data (BMP388: 1)
     } spi;
     struct {
       TwoWire *i2cBus;        // I2C bus ID
@@ -69,13 +75,60 @@ typedef struct busDevice_s {
 } busDevice_t;
 
 extern busDevice_t devices[DEVICE_MAX];
+extern volatile uint8_t busInUse;
+
+// Bus statistics, see the 'B' command
+typedef struct busStats_s {
+  unsigned long muxSwitches;      // Channel select transactions sent to the mux
+  unsigned long samples;          // busStatsSample() calls, one per sensor sample
+  unsigned long lastMuxSwitches;  // muxSwitches at the last busStatsSample()
+  uint8_t sampleMuxSwitches;      // Mux switches for the most recent sample
+  uint8_t maxSampleMuxSwitches;
+} busStats_t;
+
+extern busStats_t busStats;
+
+// Per device counters, these outlive re-detection (which re-initializes devices[])
+typedef struct busDeviceStats_s {
+  unsigned long transactions;
+  uint16_t errors;   // Failed transactions, including the ones a retry recovered from
+  uint16_t retries;  // Made by busTransactionWaitRetry()
+  uint16_t failures; // Transactions that failed every retry
+} busDeviceStats_t;
+
+extern busDeviceStats_t busDeviceStats[DEVICE_MAX];
+
+// I2C bus clocks.  Each bus starts out at 400KHz, busClockNegotiate() tries the faster clocks
+// (up to I2C_CLOCK_MAX from the board header) and keeps the fastest one that every device
+// on the bus reads back correctly at.  A bus with too many errors is stepped back down, and
+// is never negotiated above that again.  busClockLimit() caps a bus for the devices that
+// cannot be read back, like the displays.
+#define BUS_CLOCK_MAX 2 // Buses we keep track of
+
+void busClockInit(TwoWire *wire);
+void busClockReset(TwoWire *wire);
+void busClockLimit(TwoWire *wire, unsigned long hz); // A device on the bus that is not read back
+uint8_t busClockNegotiate(TwoWire *wire); // Returns the devices it checked
+unsigned long busClockHz(uint8_t bus);
+void busCountTransaction(busDevice_t *busDev, bool ok);
+#ifdef WANT_TRACE
+// The TRACE_I2C_xxx arg, the device number in the low nibble and its bus in the high one:
+// 1 and up for the I2C buses (numbered as in the 'B' report), BUS_TRACE_SPI for SPI
+#define BUS_TRACE_SPI 0x0F
+uint8_t busTraceArg(busDevice_t *busDev);
+#endif
 
 void busDeviceInit();
 void noEnableCbk(busDevice_t *busDevice, bool enableFlag);
+void spiChipSelectCbk(busDevice_t *busDevice, bool enableFlag);
 void busPrint(busDevice_t *bus, const char *function);
 busDevice_t *busDeviceInitI2C(uint8_t devNum, TwoWire *wire, uint8_t address, uint8_t channel = 0, busDevice_t *channelDev = NULL, busDeviceEnableCbk enableCbk = noEnableCbk, hwType_e hwType = HWTYPE_NONE);
-busDevice_t *busDeviceInitSPI(uint8_t devNum, SPIClass *spiBus, busDeviceEnableCbk enableCbk = noEnableCbk, hwType_e hwType = HWTYPE_NONE);
+busDevice_t *busDeviceInitSPI(uint8_t devNum, SPIClass *spiBus, uint8_t csPin, busDeviceEnableCbk enableCbk = spiChipSelectCbk, hwType_e hwType = HWTYPE_NONE);
 bool busDeviceDetect(busDevice_t *dev);
+void busDeviceVisitOrder(busDevice_t * const *devs, uint8_t count, uint8_t *order);
+void busStatsSample();
+void busStatsReport();
+void busStatsClear();
 
 // read/write Buffers
 bool busReadBuf(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length);
@@ -85,4 +138,44 @@ bool busWriteBuf(busDevice_t *busDev, unsigned short reg, unsigned char *values,
 bool busRead(busDevice_t *busDev, unsigned short reg, unsigned char *values);
 bool busWrite(busDevice_t *busDev, unsigned short reg, unsigned char value);
 
+// Asynchronous transactions (busasync.cpp)
+//
+// The caller owns the transaction (no malloc), and must leave it and the buffer alone until
+// it is finished.  Transactions on the same bus run in the order they were queued, each bus
+// has its own queue.  With WANT_ASYNC_I2C they are run by the LPI2C interrupt on the Teensy 4.0,
+// and with WANT_ASYNC_SPI SPI transactions are DMA transfers; without them
+// they run to completion before busReadBufAsync() returns.
+// The callback (can be NULL) is called from the interrupt, so it must not print.
+typedef enum {
+  BUS_TXN_IDLE = 0,
+  BUS_TXN_DONE,
+  BUS_TXN_FAILED,
+  BUS_TXN_QUEUED, // Everything from here on is still in progress
+  BUS_TXN_ACTIVE
+} busTxnState_e;
+
+typedef void (*busTransactionCbk)(struct busTransaction_s *txn);
+
+typedef struct busTransaction_s {
+  busDevice_t *busDev;
+  unsigned short reg;       // 16 bit for the EEPROM
+  uint8_t *buffer;
+  uint8_t length;
+  bool isRead;
+  volatile uint8_t state;   // busTxnState_e
+  unsigned long finishedMicros;
+  busTransactionCbk callback;
+  struct busTransaction_s *next;
+} busTransaction_t;
+
+#define busTransactionFinished(txn) ((txn)->state < BUS_TXN_QUEUED)
+
+bool busReadBufAsync(busTransaction_t *txn, busDevice_t *busDev, unsigned short reg, uint8_t *values, uint8_t length, busTransactionCbk callback = NULL);
+bool busWriteBufAsync(busTransaction_t *txn, busDevice_t *busDev, unsigned short reg, uint8_t *values, uint8_t length, busTransactionCbk callback = NULL);
+bool busTransactionWait(busTransaction_t *txn); // Returns true if it succeeded
+bool busTransactionWaitRetry(busTransaction_t *txn, uint8_t retries);
+void busAsyncWaitIdle(TwoWire *wire);           // Before using the wire directly
+void busAsyncWaitIdle(SPIClass *spi);
+void busAsyncInit();
+
 #endif
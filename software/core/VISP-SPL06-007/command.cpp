@@ -139,6 +139,19 @@ const struct dictionary_s motorTypeDict[] PUTINFLASH = {
   { -1, NULL, NULL}
 };
 
+#ifdef WANT_SAMPLING_PROFILES
+const char strLowLatencyDesc [] PUTINFLASH = "Fastest sensor rates, least oversampling";
+const char strBalancedDesc [] PUTINFLASH = "Default sensor rates and oversampling";
+const char strLowNoiseDesc [] PUTINFLASH = "Most oversampling and filtering, slower rates";
+
+const struct dictionary_s samplingProfileDict[] PUTINFLASH = {
+  {SAMPLING_LOW_LATENCY, strLowLatency, strLowLatencyDesc},
+  {SAMPLING_BALANCED,    strBalanced,   strBalancedDesc},
+  {SAMPLING_LOW_NOISE,   strLowNoise,   strLowNoiseDesc},
+  { -1, NULL, NULL}
+};
+#endif
+
 
 char * currentModeStr(char *buff, int buffSize)
 {
@@ -226,6 +239,9 @@ const char strGood[] PUTINFLASH = "good";
 const char strBad[] PUTINFLASH = "bad";
 const char strBattery[] PUTINFLASH = "Battery";
 const char strFiO2[] PUTINFLASH = "FiO2";
+#ifdef WANT_SAMPLING_PROFILES
+const char strSamplingProfile[] PUTINFLASH = "sampling";
+#endif
 
 bool noSet(struct settingsEntry_s * entry, const char *arg);
 bool verifyDictWordToInt8(struct settingsEntry_s * entry, const char *arg);
@@ -325,6 +341,24 @@ void __NOINLINE handleVispSaveSettings(struct settingsEntry_s * entry)
   saveParametersToVISP();
 }
 
+#ifdef WANT_SAMPLING_PROFILES
+// The sensors go unread while they are reprogrammed, so not in the middle of ventilating
+bool __NOINLINE verifySamplingProfile(struct settingsEntry_s * entry, const char *arg)
+{
+  if (currentMode != MODE_OFF && !LOADING_SETTINGS)
+  {
+    warning(PSTR("%S can only be changed in the OFF mode"), entry->theName);
+    return false; // Not saved, and no action
+  }
+  return verifyDictWordToInt8(entry, arg);
+}
+
+void __NOINLINE actionSamplingProfile(struct settingsEntry_s * entry)
+{
+  baroApplyProfile();
+}
+#endif
+
 void handleQueryCommand(const char *arg1, const char *arg2);
 void __NOINLINE actionQueryCommand(struct settingsEntry_s * entry)
 {
@@ -355,6 +389,9 @@ const struct settingsEntry_s settings[] PUTINFLASH = {
   {RESPOND_MOTOR_MIN_SPEED|EXPERT|SAVE_THIS,     (MODE_ALL ^ MODE_MANUAL), strmotorMaxSpeed, strPercentage,     0, 100, NULL, verifyLimitsToInt8, respondInt8, actionMotorChange, NULL, &motorMaxSpeed},
   {RESPOND_MOTOR_HOMING_SPEED|EXPERT|SAVE_THIS,  (MODE_ALL ^ MODE_MANUAL), strMotorHomingSpeed, strPercentage,  0, 100, NULL, verifyLimitsToInt8, respondInt8, actionMotorChange, NULL, &motorHomingSpeed},
   {RESPOND_MOTOR_STEPS_PER_REV|EXPERT|SAVE_THIS, (MODE_ALL ^ MODE_MANUAL), strMotorStepsPerRev, NULL, 0, 1600,    NULL, verifyLimitsToInt16, respondInt16, actionMotorChange, NULL, &motorStepsPerRev},
+#ifdef WANT_SAMPLING_PROFILES
+  {RESPOND_SAMPLING_PROFILE|EXPERT|SAVE_THIS,    MODE_OFF, strSamplingProfile, NULL, 0, 0, samplingProfileDict, verifySamplingProfile, respondInt8ToDict, actionSamplingProfile, NULL, &samplingProfile},
+#endif
   {RESPOND_DEBUG,                                (MODE_ALL ^ MODE_MANUAL), strDebug, NULL, 0, 0, enableDict, verifyDictWordToInt8, respondInt8ToDict, actionQueryCommand, NULL, &debug},
   {0, MODE_NONE,  NULL, NULL, 0, 0, NULL, NULL, NULL, NULL}
 };
@@ -673,7 +710,7 @@ void handleCalibrateCommand(const char *arg1, const char *arg2)
 // Also we have to add motor failure detection to this.
 void sendCurrentSystemHealth()
 {
-  respond('H', (sensorsFound && motorFound ? strGood : strBad));
+  respond('H', PSTR("%S,%l,%l"), (sensorsFound && motorFound ? strGood : strBad), (long)busClockHz(0), (long)busClockHz(1));
 }
 
 void handleHealthCommand(const char *arg1, const char *arg2)
@@ -703,6 +740,60 @@ void handleEepromCommand(const char *arg1, const char *arg2)
     sendEEPROMdata(0, 128);
 }
 
+void handleBusStatsCommand(const char *arg1, const char *arg2)
+{
+  if (strcasecmp_P(arg1, PSTR("reset")) == 0)
+  {
+    busStatsClear();
+    displayStatsClear();
+  }
+  else
+  {
+    busStatsReport();
+    displayStatsReport();
+  }
+}
+
+#ifdef WANT_TASK_STATS
+void handleTaskStatsCommand(const char *arg1, const char *arg2)
+{
+  if (strcasecmp_P(arg1, PSTR("reset")) == 0)
+    taskStatsClear();
+  else
+    taskStatsReport();
+}
+#endif
+
+#ifdef WANT_PROFILING
+void handleProfileCommand(const char *arg1, const char *arg2)
+{
+  if (strcasecmp_P(arg1, PSTR("reset")) == 0)
+    profileClear();
+  else
+    profileReport();
+}
+#endif
+
+#ifdef WANT_SAMPLING_PROFILES
+void handleSamplingStatsCommand(const char *arg1, const char *arg2)
+{
+  if (strcasecmp_P(arg1, PSTR("reset")) == 0)
+    baroProfileStatsClear();
+  else
+    baroProfileStatsReport();
+}
+#endif
+
+#ifdef WANT_TRACE
+void handleTraceCommand(const char *arg1, const char *arg2)
+{
+  if (strcasecmp_P(arg1, PSTR("reset")) == 0)
+    traceClear();
+  else
+    traceDump();
+}
+#endif
+
 typedef void (*commandCallback)(const char *arg1, const char *arg2);
 
 struct commandEntry_s {
@@ -717,6 +808,19 @@ const struct commandEntry_s commands[] PUTINFLASH = {
   { 'S', handleSettingCommand },
   { 'E', handleEepromCommand },
   { 'H', handleHealthCommand },
+  { 'B', handleBusStatsCommand },
+#ifdef WANT_TASK_STATS
+  { 'T', handleTaskStatsCommand },
+#endif
+#ifdef WANT_PROFILING
+  { 'P', handleProfileCommand },
+#endif
+#ifdef WANT_TRACE
+  { 'X', handleTraceCommand },
+#endif
+#ifdef WANT_SAMPLING_PROFILES
+  { 'N', handleSamplingStatsCommand },
+#endif
   { 'R', NULL}, // declare reset function at address 0
   { 0, NULL}
 };
@@ -804,26 +908,33 @@ void commandParser(int cmdByte)
 
 void dataSend()
 {
+  PROFILE_SCOPE(PROFILE_DATA_SEND);
+  vispSample_t sample;
+
+  vispReadSample(&sample);
+
+  TRACE(TRACE_SERIAL_TX, 'd', hwSerial.availableForWrite());
+
   // Take some time to write to the serial port
   hwSerial.print('d');
   hwSerial.print(',');
-  hwSerial.print(millis());
+  hwSerial.print(sample.timestamp);
   hwSerial.print(',');
-  hwSerial.print(pressure, 4);
+  hwSerial.print(sample.pressure, 4);
   hwSerial.print(',');
-  hwSerial.print(volume, 4);
+  hwSerial.print(sample.volume, 4);
   hwSerial.print(',');
-  hwSerial.print(tidalVolume, 4);
+  hwSerial.print(sample.tidalVolume, 4);
   if (debug == DEBUG_ENABLED)
   {
     hwSerial.print(',');
-    hwSerial.print(sensors[SENSOR_U5].pressure, 1);
+    hwSerial.print(sample.sensorPressure[SENSOR_U5], 1);
     hwSerial.print(',');
-    hwSerial.print(sensors[SENSOR_U6].pressure, 1);
+    hwSerial.print(sample.sensorPressure[SENSOR_U6], 1);
     hwSerial.print(',');
-    hwSerial.print(sensors[SENSOR_U7].pressure, 1);
+    hwSerial.print(sample.sensorPressure[SENSOR_U7], 1);
     hwSerial.print(',');
-    hwSerial.print(sensors[SENSOR_U8].pressure, 1);
+    hwSerial.print(sample.sensorPressure[SENSOR_U8], 1);
   }
   hwSerial.println();
 }
@@ -1055,24 +1166,36 @@ void coreSaveSettingsStateMachine()
       CORE_SAVE_SETTINGS_STATE++;
       break;
     case 19:
+#ifdef WANT_SAMPLING_PROFILES
+      i = coreSaveName(i, strSamplingProfile);
+#endif
+      CORE_SAVE_SETTINGS_STATE++;
+      break;
+    case 20:
+#ifdef WANT_SAMPLING_PROFILES
+      i = coreSaveDict(i, samplingProfileDict, samplingProfile);
+#endif
+      CORE_SAVE_SETTINGS_STATE++;
+      break;
+    case 21:
       if (i < EEPROM.length())
         EEPROM.write(i++, 0);
       else
         CORE_SAVE_SETTINGS_STATE++;
       break;
 #ifndef WANT_TRICKLE_EEPROM
-    case 20:
+    case 22:
       EEPROM.put(0, eeprom_crc());
       info(PSTR("saved"));
       CORE_SAVE_SETTINGS_STATE = 0;
       break;
 #else
-    case 20:
+    case 22:
       crc = ~0L;
       i = 4;
       CORE_SAVE_SETTINGS_STATE++;
     // break; fall through
-    case 21:
+    case 23:
       if (i < EEPROM.length())
       {
         crc = crc_table[(crc ^ EEPROM[i]) & 0x0f] ^ (crc >> 4);
@@ -1082,11 +1205,11 @@ void coreSaveSettingsStateMachine()
       else
         CORE_SAVE_SETTINGS_STATE++;
       break;
-    case 22:
+    case 24:
       EEPROM.put(0, crc);
       CORE_SAVE_SETTINGS_STATE++;
       break;
-    case 23:
+    case 25:
       info(PSTR("saved"));
       CORE_SAVE_SETTINGS_STATE = 0;
       break;
@@ -63,6 +63,7 @@ void updateMotorSpeed();
 #define RESPOND_MOTOR_STEPS_PER_REV 1UL<<24
 
 #define RESPOND_FI02                1UL<<25
+#define RESPOND_SAMPLING_PROFILE    1UL<<26
 
 void respondAppropriately(uint32_t flags);
 
@@ -64,6 +64,10 @@
 
 extern uint8_t currentMode;
 
+#ifdef WANT_CONTROL_TIMER
+extern volatile bool inControlTick; // True while the hardware timer is sampling and running the PID
+#endif
+
 typedef enum {
   DEBUG_DISABLED = 0,
   DEBUG_ENABLED
@@ -119,6 +123,10 @@ extern volatile unsigned long timeToIgnoreHome;
 
 
 #include "respond.h"
+#include "scheduler.h"
+#include "pt.h"
+#include "profile.h"
+#include "trace.h"
 #include "busdevice.h"
 #include "sensors.h"
 #include "visp.h"
@@ -24,37 +24,152 @@
 // 0X3C+SA0 - 0x3C or 0x3D
 #define I2C_ADDRESS_VISP 0x3C
 #define I2C_ADDRESS_MAIN 0x3D
+#define SSD1306_CLOCK_MAX 400000
 
+// Both displays show 4 lines of 21 characters in Adafruit5x7 (6 pixels to a character)
+#define DISPLAY_LINES   4
+#define DISPLAY_COLUMNS 21
+
+#define DISPLAY_LINE_INTERVAL 100 // ms, so each display is redrawn every 800ms
+#define DISPLAY_BUDGET_MICROS 500 // Of display I2C per pass of loop()
+
+// What Wire can take in one transaction, the control byte included
+#ifdef BUFFER_LENGTH
+#define DISPLAY_I2C_CHUNK BUFFER_LENGTH
+#else
+#define DISPLAY_I2C_CHUNK 32
+#endif
+
+// The library hands us one byte at a time.  Rather than a transaction per byte, bytes of the
+// same kind (commands or RAM) are streamed into one transaction behind a single control byte,
+// until Wire's buffer is full, the kind changes, or flush() is called.
 class SSD1306AsciiWire : public SSD1306Ascii {
   public:
     explicit SSD1306AsciiWire() {}
     void begin(TwoWire *wire, const DevType* dev, uint8_t i2cAddr) {
       m_i2cAddr = i2cAddr;
+      m_pending = 0;
       // Only if it was found..
+      busAsyncWaitIdle(wire);
+      busInUse++;
       wire->beginTransmission(m_i2cAddr);
       m_oledWire = (wire->endTransmission() == 0 ? wire : NULL);
+      busInUse--;
       init(dev);
+      flush();
+      memset(m_shadow, 0, sizeof(m_shadow)); // Nothing we would draw, so the first update draws it all
     }
+    // Start putting a new line on the glass, updateCells() does the work
+    void setLine(uint8_t row, const char *text) {
+      memcpy(m_line, text, DISPLAY_COLUMNS);
+      m_row = row;
+      m_cell = 0;
+      m_cursorCell = DISPLAY_COLUMNS + 1; // Not where the display's cursor is
+    }
+    // Only the characters that differ from what is on the glass go out on the bus.
+    // Returns true when the line is done, false when the time ran out first (call again to carry on).
+    bool updateCells(unsigned long startMicros, uint16_t budgetMicros) {
+      char *shadow = m_shadow[m_row];
+      uint8_t cellWidth = fontWidth() + letterSpacing();
+
+      for (; m_cell < DISPLAY_COLUMNS; m_cell++)
+      {
+        if (shadow[m_cell] == m_line[m_cell])
+          continue;
+        if (micros() - startMicros >= budgetMicros)
+        {
+          flush();
+          return false;
+        }
+        if (m_cursorCell != m_cell)
+          setCursor(m_cell * cellWidth, m_row);
+        write(m_line[m_cell]);
+        shadow[m_cell] = m_line[m_cell];
+        m_cursorCell = m_cell + 1;
+      }
+      flush();
+      return true;
+    }
+    // Must be called before anything else uses the bus
+    void flush() {
+      if (m_pending)
+      {
+        m_oledWire->endTransmission();
+        busInUse--;
+        bytes += m_pending;
+        transactions++;
+        m_pending = 0;
+      }
+    }
+    uint16_t bytes;
+    uint16_t transactions;
   protected:
     void writeDisplay(uint8_t b, uint8_t mode) {
       if (m_oledWire)
       {
-        m_oledWire->beginTransmission(m_i2cAddr);
-        m_oledWire->write(mode == SSD1306_MODE_CMD ? 0X00 : 0X40);
+        uint8_t control = (mode == SSD1306_MODE_CMD ? 0X00 : 0X40);
+
+        if (m_pending && (control != m_control || m_pending == DISPLAY_I2C_CHUNK - 1))
+          flush();
+        if (m_pending == 0)
+        {
+          busAsyncWaitIdle(m_oledWire);
+          busInUse++;
+          m_oledWire->beginTransmission(m_i2cAddr);
+          m_oledWire->write(control);
+          m_control = control;
+        }
         m_oledWire->write(b);
-        m_oledWire->endTransmission();
+        m_pending++;
       }
     }
   protected:
     TwoWire *m_oledWire;
     uint8_t m_i2cAddr;
+    uint8_t m_control;
+    uint8_t m_pending; // Bytes in the open transaction
+    char m_shadow[DISPLAY_LINES][DISPLAY_COLUMNS]; // What is on the glass
+    char m_line[DISPLAY_COLUMNS]; // The line being put on the glass
+    uint8_t m_row;
+    uint8_t m_cell;       // Next cell to look at
+    uint8_t m_cursorCell; // Where the display's cursor is
 };
 
+// Renders one line of text for SSD1306AsciiWire::setLine(), space filled to the full width
+class DisplayLine : public Print {
+  public:
+    explicit DisplayLine() : m_length(0) {}
+    size_t write(uint8_t c) {
+      if (m_length < DISPLAY_COLUMNS)
+        m_text[m_length++] = c;
+      return 1;
+    }
+    using Print::write;
+    const char *finish() {
+      memset(&m_text[m_length], ' ', DISPLAY_COLUMNS - m_length);
+      return m_text;
+    }
+  private:
+    char m_text[DISPLAY_COLUMNS];
+    uint8_t m_length;
+};
 
 SSD1306AsciiWire oledVISP, oledMain;
 
+typedef struct displayStats_s {
+  uint32_t updates;
+  uint16_t bytes;            // In the last update
+  uint16_t transactions;
+  uint16_t maxBytes;
+  uint16_t maxTransactions;
+} displayStats_t;
+
+displayStats_t displayStats[2]; // VISP, Main
+
 void displaySetup(TwoWire *wire)
 {
+  // The SSD1306 is only rated for Fast mode, and busClockNegotiate() has no way to check it
+  busClockLimit(wire, SSD1306_CLOCK_MAX);
   oledMain.begin(wire, &Adafruit128x64, I2C_ADDRESS_MAIN);
   oledVISP.begin(wire, &Adafruit128x32, I2C_ADDRESS_VISP);
 
@@ -65,53 +180,93 @@ void displaySetup(TwoWire *wire)
 void displayToThis(SSD1306AsciiWire *lcd, bool isVISP, uint8_t counter)
 {
   char modeBuff[16] = {0};
+  DisplayLine line;
 
   switch (counter & 0x3)
   {
 
     case 0:
       // 4 lines on a VISP, 8 on a Main
-      lcd->setCursor(0, 0);
-      lcd->print((isVISP ? F("VISP:") : F("Boxy:")));
-      lcd->print(currentModeStr(modeBuff, sizeof(modeBuff)));
-      lcd->clearToEOL();
-      lcd->println();
+      line.print((isVISP ? F("VISP:") : F("Boxy:")));
+      line.print(currentModeStr(modeBuff, sizeof(modeBuff)));
       break;
     case 1:
-      lcd->print(F("IE 1:"));
-      lcd->print(breathRatio);
-      lcd->print(F("  Rate "));
-      lcd->print(breathRate);
-      lcd->clearToEOL();
-      lcd->println();
+      line.print(F("IE 1:"));
+      line.print(breathRatio);
+      line.print(F("  Rate "));
+      line.print(breathRate);
       break;
     case 2:
-      lcd->print(F("Pressure "));
-      lcd->print(pressure);
-      lcd->print('/');
-      lcd->print(breathPressure);
-      lcd->clearToEOL();
-      lcd->println();
+      line.print(F("Pressure "));
+      line.print(pressure);
+      line.print('/');
+      line.print(breathPressure);
       break;
     case 3:
-      lcd->print(F("Volume   "));
-      lcd->print(volume);
-      lcd->print('/');
-      lcd->print(breathVolume);
-      lcd->clearToEOL();
-      lcd->println();
+      line.print(F("Volume   "));
+      line.print(volume);
+      line.print('/');
+      line.print(breathVolume);
       break;
   }
+  lcd->setLine(counter & 0x3, line.finish());
 }
 
-// We are seeing pauses in the data stream when both displays are being updated at the same time
-void displayUpdate()
+// Runs from loop() as background work.  A new line is rendered every DISPLAY_LINE_INTERVAL, and
+// put on the glass DISPLAY_BUDGET_MICROS at a time, so a busy display never holds up much else.
+// Returns true if it did anything.
+bool displayUpdate()
 {
   static uint8_t counter;
+  static SSD1306AsciiWire *lcd; // With a line in progress
+  static unsigned long nextLine;
+  unsigned long startMicros = micros();
+  displayStats_t *stats = &displayStats[(counter & 0x04) ? 1 : 0];
+
+  if (lcd == NULL)
+  {
+    if (!timeReached(millis(), nextLine))
+      return false;
+    nextLine = millis() + DISPLAY_LINE_INTERVAL;
+
+    // 8 lines of text, one at a time, alternating between the two displays every 4
+    lcd = ((counter & 0x04) ? &oledMain : &oledVISP);
+    lcd->bytes = 0;
+    lcd->transactions = 0;
+    displayToThis(lcd, (lcd == &oledVISP), counter);
+  }
+
+  PROFILE_SCOPE(PROFILE_DISPLAY_UPDATE);
+  TRACE(TRACE_DISPLAY_START, (counter & 0x04) ? DEVICE_CORE_DISPLAY : DEVICE_VISP_DISPLAY, 0);
+  bool done = lcd->updateCells(startMicros, DISPLAY_BUDGET_MICROS);
+  TRACE(TRACE_DISPLAY_END, 0, 0);
+  if (!done)
+    return true;
 
-  if (counter & 0x04)
-    displayToThis(&oledMain, false, counter);
-  else
-    displayToThis(&oledVISP, true, counter);
+  stats->updates++;
+  stats->bytes = lcd->bytes;
+  stats->transactions = lcd->transactions;
+  if (stats->bytes > stats->maxBytes)
+    stats->maxBytes = stats->bytes;
+  if (stats->transactions > stats->maxTransactions)
+    stats->maxTransactions = stats->transactions;
   counter++;
+  lcd = NULL;
+  return true;
+}
+
+void displayStatsReport()
+{
+  for (uint8_t x = 0; x < 2; x++)
+  {
+    displayStats_t *stats = &displayStats[x];
+    if (stats->updates)
+      respond('B', PSTR("display,%d,%l,%l,%l,%l,%l"), (x ? DEVICE_CORE_DISPLAY : DEVICE_VISP_DISPLAY), (long)stats->updates,
+              (long)stats->bytes, (long)stats->transactions, (long)stats->maxBytes, (long)stats->maxTransactions);
+  }
+}
+
+void displayStatsClear()
+{
+  memset(&displayStats, 0, sizeof(displayStats));
 }
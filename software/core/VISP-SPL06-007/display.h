@@ -21,6 +21,8 @@
 #define __DISPLAY_H__
 
 void displaySetup(TwoWire *wire);
-void displayUpdate();
+bool displayUpdate();
+void displayStatsReport();
+void displayStatsClear();
 
 #endif
@@ -19,29 +19,140 @@
 
 #include "config.h"
 
-bool readEEPROM(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length)
+
+typedef enum {
+  EEPROM_IDLE = 0,
+  EEPROM_DONE,
+  EEPROM_FAILED,
+  EEPROM_TRANSFER,    // Everything from here on is still in progress
+  EEPROM_WRITE_CYCLE  // Polling for the acknowledge that ends the write cycle
+} eepromState_e;
+
+typedef struct eepromJob_s {
+  busDevice_t *busDev;
+  unsigned short reg;
+  unsigned char *values;
+  uint8_t length;
+  uint8_t offset;     // Of the page on the bus
+  bool isWrite;
+  bool again;         // A save came in while we were writing, start over when done
+  uint8_t state;      // eepromState_e
+  unsigned long writeStarted;
+  busTransaction_t txn;
+} eepromJob_t;
+
+eepromJob_t eepromJob;
+
+// The lower level WIRE library has a buffer limitation, so staying in EEPROM_PAGE_SIZE intervals is a good thing
+// Writes must align on page size boundaries (otherwise it wraps to the beginning of the page)
+static void eepromStartPage()
 {
-  // loop through the length using EEPROM_PAGE_SIZE intervals
-  // The lower level WIRE library has a buffer limitation, so staying in EEPROM_PAGE_SIZE intervals is a good thing
-  for (unsigned short x = 0; x < length; x += EEPROM_PAGE_SIZE)
-  {
-    if (!busReadBuf(busDev, reg + x, &values[x], min(EEPROM_PAGE_SIZE, (length - x))))
-      return false;
-  }
+  uint8_t pageLength = min(EEPROM_PAGE_SIZE, (eepromJob.length - eepromJob.offset));
+
+  eepromJob.state = EEPROM_TRANSFER;
+  if (eepromJob.isWrite)
+    busWriteBufAsync(&eepromJob.txn, eepromJob.busDev, eepromJob.reg + eepromJob.offset, &eepromJob.values[eepromJob.offset], pageLength);
+  else
+    busReadBufAsync(&eepromJob.txn, eepromJob.busDev, eepromJob.reg + eepromJob.offset, &eepromJob.values[eepromJob.offset], pageLength);
+}
+
+static bool eepromStart(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length, bool isWrite)
+{
+  if (busDev == NULL || length == 0 || eepromBusy())
+    return false;
+
+  eepromJob.busDev = busDev;
+  eepromJob.reg = reg;
+  eepromJob.values = values;
+  eepromJob.length = length;
+  eepromJob.offset = 0;
+  eepromJob.isWrite = isWrite;
+  eepromJob.again = false;
+  eepromStartPage();
   return true;
 }
 
-bool writeEEPROM(busDevice_t *busDev, unsigned short reg, unsigned char *values, char length)
+bool eepromStartRead(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length)
+{
+  return eepromStart(busDev, reg, values, length, false);
+}
+
+bool eepromStartWrite(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length)
 {
-  // loop through the length using EEPROM_PAGE_SIZE intervals
-  // Writes must align on page size boundaries (otherwise it wraps to the beginning of the page)
   if (reg % EEPROM_PAGE_SIZE)
     return false;
 
-  for (unsigned short x = 0; x < length; x += EEPROM_PAGE_SIZE)
+  // Saving the same thing again while it is being written, the RAM copy may have changed
+  // under pages that are already done.
+  if (eepromBusy() && eepromJob.isWrite && eepromJob.busDev == busDev && eepromJob.values == values)
   {
-    if (!busWriteBuf(busDev, reg + x, &values[x], min(EEPROM_PAGE_SIZE, (length - x))))
-      return false;
+    eepromJob.again = true;
+    return true;
   }
-  return true;
+  return eepromStart(busDev, reg, values, length, true);
+}
+
+bool eepromBusy()
+{
+  return eepromJob.state >= EEPROM_TRANSFER;
+}
+
+bool eepromSucceeded()
+{
+  return eepromJob.state == EEPROM_DONE;
+}
+
+// One step of the job per call, nothing in here waits on the bus
+void eepromService()
+{
+  switch (eepromJob.state)
+  {
+    case EEPROM_TRANSFER:
+      if (!busTransactionFinished(&eepromJob.txn))
+        return;
+      if (eepromJob.txn.state != BUS_TXN_DONE)
+        break;
+      if (eepromJob.isWrite)
+      {
+        eepromJob.state = EEPROM_WRITE_CYCLE;
+        eepromJob.writeStarted = millis();
+        return;
+      }
+      eepromJob.offset += eepromJob.txn.length;
+      if (eepromJob.offset < eepromJob.length)
+      {
+        eepromStartPage();
+        return;
+      }
+      eepromJob.state = EEPROM_DONE;
+      return;
+
+    case EEPROM_WRITE_CYCLE:
+      // The EEPROM does not acknowledge its address until the page is written
+      if (!busDeviceDetect(eepromJob.busDev))
+      {
+        if (millis() - eepromJob.writeStarted > EEPROM_WRITE_TIMEOUT)
+          break;
+        return;
+      }
+      eepromJob.offset += eepromJob.txn.length;
+      if (eepromJob.offset >= eepromJob.length && eepromJob.again)
+      {
+        eepromJob.offset = 0;
+        eepromJob.again = false;
+      }
+      if (eepromJob.offset < eepromJob.length)
+      {
+        eepromStartPage();
+        return;
+      }
+      eepromJob.state = EEPROM_DONE;
+      return;
+
+    default:
+      return;
+  }
+
+  warning(PSTR("VISP eeprom %S failed at 0x%x"), (eepromJob.isWrite ? PSTR("write") : PSTR("read")), eepromJob.reg + eepromJob.offset);
+  eepromJob.state = EEPROM_FAILED;
 }
@@ -28,7 +28,15 @@ static_assert (sizeof(visp_eeprom_t) == 128, "Size is not correct");
 
 extern visp_eeprom_t visp_eeprom;
 
-bool readEEPROM(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length);
-bool writeEEPROM(busDevice_t *busDev, unsigned short reg, unsigned char *values, char length);
+// EEPROM access is a background job, one page at a time, so that a save never holds up
+// sampling or the control loop.  Only one job runs at a time; start it, then poll
+// eepromBusy() (eepromService() is run by the scheduler and moves the job along).
+#define EEPROM_WRITE_TIMEOUT 20 // ms, the M24C01 write cycle is 5ms max
+
+bool eepromStartRead(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length);
+bool eepromStartWrite(busDevice_t *busDev, unsigned short reg, unsigned char *values, uint8_t length);
+bool eepromBusy();
+bool eepromSucceeded(); // How the last job ended
+void eepromService();
 
 #endif
@@ -44,6 +44,11 @@ volatile uint32_t lastHomeTime = 0;
 
 static bool motorWasGoingForward = false;
 
+// hbridgeReverseDirection() lets the motor spin down before driving it the other way
+#define HBRIDGE_REVERSE_TIME 10 // ms
+static bool hbridgeReversing = false;
+static unsigned long hbridgeReverseTime = 0;
+
 // Defaults for Daren's hardware
 int8_t motorSpeed = 0; // 0->100 as a percentage
 int8_t motorType = MOTOR_HBRIDGE;
@@ -57,11 +62,13 @@ volatile unsigned long encoderCount = 0;
 void encoderTriggered() // IRQ function (Future finding the perfect home)
 {
   encoderCount++;
+  TRACE(TRACE_ENCODER_IRQ, 0, encoderCount);
 }
 
 void homeTriggered() // IRQ function
 {
   uint32_t currentTime = millis();
+  TRACE(TRACE_HOME_IRQ, 0, 0);
   if ( lastHomeTime > currentTime )
   {
     lastHomeTime = currentTime;
@@ -77,6 +84,11 @@ void homeTriggered() // IRQ function
 
 void __NOINLINE hbridgeGo()
 {
+  PROFILE_SCOPE(PROFILE_HBRIDGE_GO);
+
+  // hbridgeRun() will drive it once it has stopped, at whatever motorSpeed is by then
+  if (hbridgeReversing)
+    return;
   if (motorWasGoingForward)
   {
     digitalWrite(MOTOR_HBRIDGE_L_EN, 0); // Set thes in opposite order of hbridgeReverse() so we don't have both pins active at the same time
@@ -90,6 +102,7 @@ void __NOINLINE hbridgeGo()
   if ( motorSpeed > motorMaxSpeed)
     motorSpeed = motorMaxSpeed;
   analogWrite(MOTOR_HBRIDGE_PWM, scaleAnalog(motorSpeed, 0, MAX_PWM));
+  TRACE(TRACE_MOTOR_COMMAND, motorRunState, motorSpeed);
   updateMotorSpeed();
 }
 
@@ -101,22 +114,39 @@ void __NOINLINE hbridgeReverseDirection()
   // Stop the motor
   analogWrite(MOTOR_HBRIDGE_PWM, 0);
 
-  // If it was movong, give it a bit to actually stop, so we don't fry the controlling chip
-  if (motorSpeed)
-    delay(10);
   info(PSTR("Motor Reversing Direction (Going home)"));
   motorRunState = MOTOR_HOMING;
-  hbridgeGo();
+
+  // If it was movong, give it a bit to actually stop, so we don't fry the controlling chip
+  if (motorSpeed)
+  {
+    hbridgeReversing = true;
+    hbridgeReverseTime = millis() + HBRIDGE_REVERSE_TIME;
+  }
+  else
+    hbridgeGo();
+}
+
+// Called from loop(), finishes off a hbridgeReverseDirection()
+void __NOINLINE hbridgeRun()
+{
+  if (hbridgeReversing && timeReached(millis(), hbridgeReverseTime))
+  {
+    hbridgeReversing = false;
+    hbridgeGo();
+  }
 }
 
 void __NOINLINE hbridgeStop()
 {
+  hbridgeReversing = false;
   analogWrite(MOTOR_HBRIDGE_PWM, 0);
   digitalWrite(MOTOR_HBRIDGE_L_EN, 0);
   digitalWrite(MOTOR_HBRIDGE_R_EN, 0);
 
   motorSpeed = 0;
   motorRunState = MOTOR_STOPPED;
+  TRACE(TRACE_MOTOR_COMMAND, motorRunState, motorSpeed);
   updateMotorSpeed();
 }
 
@@ -150,6 +180,7 @@ void __NOINLINE stepperGo()
     motorSpeed = motorMaxSpeed;
   int theSpeed = scaleAnalog(motorSpeed, 0, STEPPER_MAX_SPEED);
   stepper_setSpeed((motorWasGoingForward ? theSpeed : -theSpeed));
+  TRACE(TRACE_MOTOR_COMMAND, motorRunState, motorSpeed);
   updateMotorSpeed();
 }
 
@@ -165,6 +196,7 @@ void __NOINLINE stepperStop()
   stepper_stop(); // Stop as fast as possible: sets new target (not runSpeed)
   motorSpeed = 0;
   motorRunState = MOTOR_STOPPED;
+  TRACE(TRACE_MOTOR_COMMAND, motorRunState, motorSpeed);
   updateMotorSpeed();
 }
 
@@ -278,7 +310,6 @@ void motorDetect()
       stepper_enableOutputs();
       stepper_setSpeed(-STEPPER_SWEEP_SPEED); // Run negative (CCW) so that DIR signal is LOW as to not activate L_EN (HBridge = FRY BABY FRY!)
       encoderCount = 0;
-      delay(100);
       motorDetectionState=WAIT_STEPPER;
       break;
     case WAIT_STEPPER:
@@ -357,7 +388,7 @@ void motorSetup()
       motorSlowDown = hbridgeSlowDown;
       motorReverseDirection = hbridgeReverseDirection;
       motorStop = hbridgeStop;
-      motorRun = doNothing; // HBRIDGE does not need to be told to step
+      motorRun = hbridgeRun; // HBRIDGE does not need to be told to step, only to finish reversing
       motorDetectionState = DO_NOTHING; // YEA! It's found!
       motorGo = hbridgeGo;
       break;
@@ -14,6 +14,8 @@
 //#define WANT_BMP280 1 // 2306 bytes
 #define WANT_SPL06  1 // 1350 bytes
 
+#define WANT_FIXED_POINT_COMPENSATION 1 // No software float in the sensor compensation
+
 #define MAX_ANALOG 1024
 #define MAX_PWM 255
 
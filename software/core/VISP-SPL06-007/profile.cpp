@@ -0,0 +1,100 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+
+   Author: Steven.Carr@hammontonmakers.org
+*/
+
+
+#include "config.h"
+
+#ifdef WANT_PROFILING
+profileProbe_t profileProbes[PROFILE_MAX];
+
+const char strProfileSpl06Calculate[] PUTINFLASH = "spl06Calculate";
+const char strProfileSpl06Compensate[] PUTINFLASH = "spl06Compensate";
+const char strProfileBmp280Calculate[] PUTINFLASH = "bmp280Calculate";
+const char strProfileBmp280Compensate[] PUTINFLASH = "bmp280Compensate";
+const char strProfileBmp388Calculate[] PUTINFLASH = "bmp388Calculate";
+const char strProfileBmp388Compensate[] PUTINFLASH = "bmp388Compensate";
+const char strProfileVenturi[] PUTINFLASH = "calculateVenturiValues";
+const char strProfilePitot[] PUTINFLASH = "calculatePitotValues";
+const char strProfileTidalVolume[] PUTINFLASH = "calculateTidalVolume";
+const char strProfileControlStep[] PUTINFLASH = "controlStep";
+const char strProfileHbridgeGo[] PUTINFLASH = "hbridgeGo";
+const char strProfileDataSend[] PUTINFLASH = "dataSend";
+const char strProfileDisplayUpdate[] PUTINFLASH = "displayUpdate";
+const char * const profileNames[PROFILE_MAX] PUTINFLASH = {
+  strProfileSpl06Calculate,
+  strProfileSpl06Compensate,
+  strProfileBmp280Calculate,
+  strProfileBmp280Compensate,
+  strProfileBmp388Calculate,
+  strProfileBmp388Compensate,
+  strProfileVenturi,
+  strProfilePitot,
+  strProfileTidalVolume,
+  strProfileControlStep,
+  strProfileHbridgeGo,
+  strProfileDataSend,
+  strProfileDisplayUpdate
+};
+
+void profileInit()
+{
+#ifdef ARDUINO_TEENSY40
+  // The core normally has this running already, but make sure
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+  profileClear();
+}
+
+void profileRecord(uint8_t probe, uint32_t ticks)
+{
+  profileProbe_t *p = &profileProbes[probe];
+
+  if (p->count == 0 || ticks < p->minTicks)
+    p->minTicks = ticks;
+  if (ticks > p->maxTicks)
+    p->maxTicks = ticks;
+  p->totalTicks += ticks;
+  p->count++;
+}
+
+// P,<t>,<name>,<count>,<min>,<mean>,<max>,<ticks per microsecond>
+void profileReport()
+{
+  for (uint8_t x = 0; x < PROFILE_MAX; x++)
+  {
+    profileProbe_t *p = &profileProbes[x];
+
+    if (p->count == 0)
+      continue;
+    respond('P', PSTR("%S,%l,%l,%l,%l,%l"),
+            (const char *)pgm_read_ptr(&profileNames[x]),
+            (long)p->count,
+            (long)p->minTicks,
+            (long)(p->totalTicks / p->count),
+            (long)p->maxTicks,
+            (long)PROFILE_TICKS_PER_MICRO);
+  }
+}
+
+void profileClear()
+{
+  memset(&profileProbes, 0, sizeof(profileProbes));
+}
+#endif
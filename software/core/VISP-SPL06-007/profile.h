@@ -0,0 +1,88 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+
+   Author: Steven.Carr@hammontonmakers.org
+*/
+
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+// Named probes around the hot path, reported with the 'P' command.
+//
+// PROFILE_SCOPE(PROFILE_xxx) times from that line to the end of the enclosing block.
+// Teensy 4.0 counts CPU cycles with the DWT cycle counter, everything else falls back to micros().
+// Without WANT_PROFILING the probes compile to nothing.
+typedef enum {
+  PROFILE_SPL06_CALCULATE = 0,
+  PROFILE_SPL06_COMPENSATE,
+  PROFILE_BMP280_CALCULATE,
+  PROFILE_BMP280_COMPENSATE,
+  PROFILE_BMP388_CALCULATE,
+  PROFILE_BMP388_COMPENSATE,
+  PROFILE_VENTURI,
+  PROFILE_PITOT,
+  PROFILE_TIDAL_VOLUME,
+  PROFILE_CONTROL_STEP,
+  PROFILE_HBRIDGE_GO,
+  PROFILE_DATA_SEND,
+  PROFILE_DISPLAY_UPDATE,
+  PROFILE_MAX
+} profileProbe_e;
+
+#ifdef WANT_PROFILING
+
+#ifdef ARDUINO_TEENSY40
+#define profileTicks() (ARM_DWT_CYCCNT)
+#define PROFILE_TICKS_PER_MICRO (F_CPU_ACTUAL / 1000000)
+#else
+#define profileTicks() micros()
+#define PROFILE_TICKS_PER_MICRO 1
+#endif
+
+typedef struct profileProbe_s {
+  uint32_t count;
+  uint32_t minTicks;
+  uint32_t maxTicks;
+  uint64_t totalTicks;
+} profileProbe_t;
+
+void profileInit();
+void profileRecord(uint8_t probe, uint32_t ticks);
+void profileReport();
+void profileClear();
+
+class profileScope {
+  public:
+    explicit profileScope(uint8_t probe) : m_probe(probe), m_start(profileTicks()) {}
+    ~profileScope() {
+      profileRecord(m_probe, profileTicks() - m_start);
+    }
+  private:
+    uint8_t m_probe;
+    uint32_t m_start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(probe) profileScope PROFILE_CONCAT(profileScope_, __LINE__)(probe)
+
+#else
+#define profileInit()
+#define PROFILE_SCOPE(probe)
+#endif
+
+#endif
@@ -0,0 +1,78 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+
+   Author: Steven.Carr@hammontonmakers.org
+*/
+
+
+#ifndef __PT_H__
+#define __PT_H__
+
+// Stackless coroutines (protothreads), so long running jobs like sensor detection can wait
+// without calling delay() and stalling loop().
+//
+// A protothread is a function taking a pt_t and returning one of the PT_xxx states below.
+// It is called over and over; PT_SLEEP()/PT_WAIT_UNTIL()/PT_YIELD() return to the caller and
+// the next call resumes on that line.  Local variables do NOT survive a wait, keep anything
+// that must in a static or in the context handed to the thread.
+//
+// The resume point is a switch() case label named after the source line, so do not use switch()
+// between PT_BEGIN and PT_END, and put no more than one PT_ wait on any one line.
+//
+//  char blinkThread(pt_t *pt)
+//  {
+//    PT_BEGIN(pt);
+//    digitalWrite(LED, HIGH);
+//    PT_SLEEP(pt, 100);
+//    digitalWrite(LED, LOW);
+//    PT_END(pt);
+//  }
+
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED  2 // Gave up part way through (PT_EXIT)
+#define PT_ENDED   3 // Ran off the end (PT_END)
+
+typedef struct pt_s {
+  uint16_t lc;              // Line to resume from, 0 is the start
+  unsigned long wakeTime;   // millis() for PT_SLEEP
+} pt_t;
+
+#define PT_INIT(pt)   do { (pt)->lc = 0; } while (0)
+
+#define PT_BEGIN(pt)  switch ((pt)->lc) { case 0:
+
+#define PT_END(pt)    } (pt)->lc = 0; return PT_ENDED
+
+#define PT_EXIT(pt)   do { (pt)->lc = 0; return PT_EXITED; } while (0)
+
+#define PT_WAIT_UNTIL(pt, condition) \
+  do { (pt)->lc = __LINE__; case __LINE__: if (!(condition)) return PT_WAITING; } while (0)
+
+#define PT_WAIT_WHILE(pt, condition) PT_WAIT_UNTIL(pt, !(condition))
+
+// Always gives loop() a turn, even if there is nothing to wait for
+#define PT_YIELD(pt) \
+  do { (pt)->lc = __LINE__; return PT_YIELDED; case __LINE__:; } while (0)
+
+#define PT_SLEEP(pt, ms) \
+  do { (pt)->wakeTime = millis() + (ms); PT_WAIT_UNTIL(pt, timeReached(millis(), (pt)->wakeTime)); } while (0)
+
+// Run a child protothread to completion, 'result' gets its PT_EXITED or PT_ENDED
+#define PT_SPAWN(pt, child, thread, result) \
+  do { PT_INIT(child); PT_WAIT_UNTIL(pt, ((result) = (thread)) >= PT_EXITED); } while (0)
+
+#endif
@@ -33,6 +33,8 @@ void respond(char command, PGM_P fmt, ...)
   if (command == 'g' && debug == DEBUG_DISABLED)
     return;
 
+  TRACE(TRACE_SERIAL_TX, command, hwSerial.availableForWrite());
+
   hwSerial.print(command);
   hwSerial.print(',');
   hwSerial.print(millis());
@@ -0,0 +1,248 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+
+   Author: Steven.Carr@hammontonmakers.org
+*/
+
+
+#include "config.h"
+
+// Head of the list of tasks, ordered by tNext (ties go to the higher priority)
+static task_t *taskQueue = NULL;
+static task_t *taskTable = NULL;
+
+#ifdef WANT_TASK_STATS
+taskStats_t backgroundStats[STATS_BACKGROUND_MAX];
+
+const char strStatsLoop[] PUTINFLASH = "loop";
+const char strStatsMotorRun[] PUTINFLASH = "motorRun";
+const char strStatsCommandParser[] PUTINFLASH = "commandParser";
+const char strStatsSensorAcquire[] PUTINFLASH = "sensorAcquire";
+const char strStatsSensorSkew[] PUTINFLASH = "sensorSkew";
+const char strStatsDisplayUpdate[] PUTINFLASH = "displayUpdate";
+#ifdef WANT_COHERENT_SAMPLING
+const char strStatsTriggerSkew[] PUTINFLASH = "triggerSkew";
+#endif
+#ifdef WANT_CONTROL_TIMER
+const char strStatsControlTick[] PUTINFLASH = "controlTick";
+#endif
+const char * const backgroundStatsNames[STATS_BACKGROUND_MAX] PUTINFLASH = {
+  strStatsLoop,
+  strStatsMotorRun,
+  strStatsCommandParser,
+  strStatsSensorAcquire,
+  strStatsSensorSkew,
+  strStatsDisplayUpdate,
+#ifdef WANT_COHERENT_SAMPLING
+  strStatsTriggerSkew,
+#endif
+#ifdef WANT_CONTROL_TIMER
+  strStatsControlTick
+#endif
+};
+
+void taskStatsRecord(taskStats_t *stats, unsigned long runMicros)
+{
+  uint8_t bucket = 0;
+
+  if (stats->count == 0 || runMicros < stats->minMicros)
+    stats->minMicros = runMicros;
+  if (runMicros > stats->maxMicros)
+    stats->maxMicros = runMicros;
+  stats->totalMicros += runMicros;
+  stats->count++;
+
+  for (unsigned long r = runMicros; r > 1 && bucket < (TASK_HISTOGRAM_BUCKETS - 1); r >>= 1)
+    bucket++;
+  if (stats->histogram[bucket] != 0xFFFF)
+    stats->histogram[bucket]++;
+}
+
+// Fixed delay tasks slide by design, so only fixed rate tasks get jitter figures.
+// Intervals of two periods or more were skipped releases, those are counted as misses instead.
+static void taskStatsJitter(task_t *task, unsigned long startMicros)
+{
+  taskStats_t *stats = &task->stats;
+  unsigned long period = task->tPeriod * 1000UL;
+
+  if (task->tMode == TASK_FIXED_RATE && stats->count)
+  {
+    unsigned long interval = startMicros - stats->lastStartMicros;
+    if (interval < 2 * period)
+    {
+      unsigned long jitter = (interval > period ? interval - period : period - interval);
+      if (jitter > stats->jitterMaxMicros)
+        stats->jitterMaxMicros = jitter;
+      stats->jitterTotalMicros += jitter;
+      stats->jitterCount++;
+    }
+  }
+  stats->lastStartMicros = startMicros;
+}
+
+static void taskStatsPrint(const char *name, taskStats_t *stats)
+{
+  hwSerial.print('T');
+  hwSerial.print(',');
+  hwSerial.print(millis());
+  hwSerial.print(',');
+  printp(name);
+  hwSerial.print(',');
+  hwSerial.print(stats->count);
+  hwSerial.print(',');
+  hwSerial.print(stats->minMicros);
+  hwSerial.print(',');
+  hwSerial.print(stats->count ? stats->totalMicros / stats->count : 0);
+  hwSerial.print(',');
+  hwSerial.print(stats->maxMicros);
+  hwSerial.print(',');
+  hwSerial.print(stats->misses);
+  hwSerial.print(',');
+  hwSerial.print(stats->jitterCount ? stats->jitterTotalMicros / stats->jitterCount : 0);
+  hwSerial.print(',');
+  hwSerial.print(stats->jitterMaxMicros);
+  for (uint8_t x = 0; x < TASK_HISTOGRAM_BUCKETS; x++)
+  {
+    hwSerial.print(',');
+    hwSerial.print(stats->histogram[x]);
+  }
+  hwSerial.println();
+}
+
+void taskStatsReport()
+{
+  for (uint8_t x = 0; taskTable && taskTable[x].cbk; x++)
+    taskStatsPrint(taskTable[x].name, &taskTable[x].stats);
+  for (uint8_t x = 0; x < STATS_BACKGROUND_MAX; x++)
+    taskStatsPrint((const char *)pgm_read_ptr(&backgroundStatsNames[x]), &backgroundStats[x]);
+}
+
+void taskStatsClear()
+{
+  for (uint8_t x = 0; taskTable && taskTable[x].cbk; x++)
+    memset(&taskTable[x].stats, 0, sizeof(taskStats_t));
+  memset(&backgroundStats, 0, sizeof(backgroundStats));
+}
+#endif
+
+static void schedulerInsert(task_t *task)
+{
+  task_t **pos = &taskQueue;
+
+  while (*pos)
+  {
+    long delta = (long)(task->tNext - (*pos)->tNext);
+    if (delta < 0 || (delta == 0 && task->priority < (*pos)->priority))
+      break;
+    pos = &(*pos)->next;
+  }
+  task->next = *pos;
+  *pos = task;
+}
+
+// Of all the tasks that are due at 'now', unlink and return the highest priority one.
+// Due tasks are always at the front of the queue, so we only scan that part of it.
+static task_t *schedulerTakeDue(unsigned long now)
+{
+  task_t **best = NULL;
+
+  for (task_t **pos = &taskQueue; *pos && timeReached(now, (*pos)->tNext); pos = &(*pos)->next)
+  {
+    if (best == NULL || (*pos)->priority < (*best)->priority)
+      best = pos;
+  }
+
+  if (best == NULL)
+    return NULL;
+
+  task_t *task = *best;
+  *best = task->next;
+  task->next = NULL;
+  return task;
+}
+
+static void schedulerReschedule(task_t *task)
+{
+  unsigned long now = millis();
+
+  // A zero period still has to wait for the next tick, or schedulerRun() would never return
+  if (task->tPeriod == 0)
+    task->tNext = now + 1;
+  else if (task->tMode == TASK_FIXED_DELAY)
+    task->tNext = now + task->tPeriod;
+  else
+  {
+#ifdef WANT_TASK_STATS
+    // Finished after the following release was already due
+    if ((long)(now - (task->tNext + task->tPeriod)) > 0 && task->stats.misses != 0xFFFF)
+      task->stats.misses++;
+#endif
+    // Stay on the grid, skipping any releases we were too late for
+    do
+      task->tNext += task->tPeriod;
+    while (timeReached(now, task->tNext));
+  }
+  schedulerInsert(task);
+}
+
+// The table is terminated with a NULL callback, and its order sets the priority
+void schedulerInit(task_t *taskList)
+{
+  unsigned long now = millis();
+
+  taskQueue = NULL;
+  taskTable = taskList;
+  for (uint8_t x = 0; taskList[x].cbk; x++)
+  {
+    taskList[x].priority = x;
+    taskList[x].tNext = now;
+    schedulerInsert(&taskList[x]);
+  }
+}
+
+// Name of the task at this index in the table, NULL past the end of it
+const char *schedulerTaskName(uint8_t index)
+{
+  for (uint8_t x = 0; taskTable && taskTable[x].cbk; x++)
+    if (x == index)
+      return taskTable[x].name;
+  return NULL;
+}
+
+// Run everything that is due right now, highest priority first.
+// Each task runs at most once per call, so loop() still gets to service the motor and serial port.
+unsigned long schedulerRun()
+{
+  unsigned long accrued = 0L;
+  unsigned long now = millis();
+  task_t *task;
+
+  while ((task = schedulerTakeDue(now)) != NULL)
+  {
+    unsigned long startTime = micros();
+    TRACE(TRACE_TASK_START, task->priority, 0);
+    task->cbk();
+    TRACE(TRACE_TASK_END, task->priority, 0);
+    unsigned long runTime = micros() - startTime;
+    accrued += runTime;
+#ifdef WANT_TASK_STATS
+    taskStatsJitter(task, startTime);
+    taskStatsRecord(&task->stats, runTime);
+#endif
+    schedulerReschedule(task);
+  }
+  return accrued;
+}
@@ -0,0 +1,102 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+
+   Author: Steven.Carr@hammontonmakers.org
+*/
+
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+// Timer driven tasks are kept in a list ordered by when they are next due.
+//
+// TASK_FIXED_RATE tasks are released on a fixed grid (next = last release + period), so the
+// time spent inside the callback does not push the following release out.  If we fall
+// behind by more than a period, the missed releases are dropped rather than run back to back.
+//
+// TASK_FIXED_DELAY tasks are released a period after the callback finished (the way the
+// original tasks[] table worked), for housekeeping that is allowed to slide.
+typedef enum {
+  TASK_FIXED_RATE = 0,
+  TASK_FIXED_DELAY
+} taskMode_e;
+
+typedef void (*tCBK)();
+
+#ifdef WANT_TASK_STATS
+#define TASK_HISTOGRAM_BUCKETS 16 // Bucket n counts runtimes of 2^n to 2^(n+1)-1 micros, the last one is open ended
+
+typedef struct taskStats_s {
+  unsigned long count;
+  unsigned long minMicros;
+  unsigned long maxMicros;
+  unsigned long totalMicros;       // Wraps after ~71 minutes of accumulated runtime, clear with "T,reset"
+  unsigned long jitterMaxMicros;   // Worst deviation of the start to start interval from the period
+  unsigned long jitterTotalMicros;
+  unsigned long jitterCount;
+  unsigned long lastStartMicros;
+  uint16_t misses;                 // Still running (or never started) when the next release came due
+  uint16_t histogram[TASK_HISTOGRAM_BUCKETS];
+} taskStats_t;
+
+// Work done directly from loop(), outside of the task table
+typedef enum {
+  STATS_LOOP = 0,     // Time between the starts of loop(), the longest anything waits for its turn
+  STATS_MOTOR_RUN,
+  STATS_COMMAND_PARSER,
+  STATS_SENSOR_ACQUIRE, // From queueing the sensor reads to the last one landing
+  STATS_SENSOR_SKEW,    // Between the first and last sensor of a sample landing
+  STATS_DISPLAY_UPDATE, // Each slice of display work
+#ifdef WANT_COHERENT_SAMPLING
+  STATS_TRIGGER_SKEW,   // Between the first and last forced conversion trigger landing
+#endif
+#ifdef WANT_CONTROL_TIMER
+  STATS_CONTROL_TICK, // misses are ticks that found the bus busy and skipped sampling
+#endif
+  STATS_BACKGROUND_MAX
+} backgroundStats_e;
+
+extern taskStats_t backgroundStats[STATS_BACKGROUND_MAX];
+#endif
+
+typedef struct task_s {
+  unsigned long tNext;    // millis() when this task is next due
+  unsigned int  tPeriod;  // 64 second max period
+  taskMode_e    tMode;
+  tCBK cbk;
+  const char *name;       // In flash, used for the statistics report
+  uint8_t priority;       // Position in the task table, 0 is the highest priority
+  struct task_s *next;    // Next task to come due
+#ifdef WANT_TASK_STATS
+  taskStats_t stats;
+#endif
+} task_t;
+
+// millis() rolls over every 49.7 days, so never compare timestamps directly.
+// True when time 'a' is at, or after, time 'b'
+#define timeReached(a, b) ((long)((a) - (b)) >= 0)
+
+void schedulerInit(task_t *taskList);
+unsigned long schedulerRun(); // Returns the micros() spent in callbacks
+const char *schedulerTaskName(uint8_t index);
+
+#ifdef WANT_TASK_STATS
+void taskStatsRecord(taskStats_t *stats, unsigned long runMicros);
+void taskStatsReport();
+void taskStatsClear();
+#endif
+
+#endif
@@ -73,18 +73,84 @@ typedef struct {
   int16_t c30;
 } spl06_coeffs_t;
 
+#ifdef WANT_FIXED_POINT_COMPENSATION
+// The second and third order coefficients with the pressure scale factor folded in, see
+// spl06_read_calibration_coefficients().  The comments are their fractional bits.
+typedef struct {
+  int32_t c10; // Q14
+  int32_t c20; // Q20
+  int32_t c30; // Q26
+  int32_t c11; // Q17
+  int32_t c21; // Q23
+} spl06_fixed_coeffs_t;
+#endif
+
+// BMP388, see Datasheet 3.11.1 Memory Map Trimming Coefficients
+typedef struct bmp388_raw_param_s {
+  uint16_t param_T1;
+  uint16_t param_T2;
+  int8_t param_T3;
+  int16_t param_P1;
+  int16_t param_P2;
+  int8_t param_P3;
+  int8_t param_P4;
+  uint16_t param_P5;
+  uint16_t param_P6;
+  int8_t param_P7;
+  int8_t param_P8;
+  int16_t param_P9;
+  int8_t param_P10;
+  int8_t param_P11;
+} __attribute__((packed)) bmp388_raw_param_t;
+
+
+#if defined(WANT_COHERENT_SAMPLING) && (defined(WANT_SENSOR_FIFO) || defined(WANT_SENSOR_DRDY))
+#error "WANT_COHERENT_SAMPLING triggers the conversions itself, it does not go with WANT_SENSOR_FIFO or WANT_SENSOR_DRDY"
+#endif
 
-struct baroDev_s;
-typedef bool (*baroOpFuncPtr)(struct baroDev_s * baro);
-typedef bool (*baroCalculateFuncPtr)(struct baroDev_s * baro);
+#if defined(WANT_SAMPLING_PROFILES) && (defined(WANT_SENSOR_FIFO) || defined(WANT_COHERENT_SAMPLING) || defined(WANT_FIXED_POINT_COMPENSATION))
+#error "WANT_SAMPLING_PROFILES changes the oversampling and rates, WANT_SENSOR_FIFO, WANT_COHERENT_SAMPLING and WANT_FIXED_POINT_COMPENSATION are built for their own"
+#endif
 
+#ifdef WANT_SENSOR_FIFO
+#define BARO_FIFO_DEPTH 8                      // Most samples picked up from a FIFO in one read
+#define BARO_FRAME_MAX  (BARO_FIFO_DEPTH * 7)  // BMP388 FIFO frames are a header and 6 bytes
+#define BARO_TXN_MAX    BARO_FIFO_DEPTH        // The SPL06 gives up one FIFO result per read
+
+typedef struct baroSample_s {
+  float pressure;
+  unsigned long micros; // When the sensor took it (estimated, see baroFinishSamples())
+} baroSample_t;
+#else
+#define BARO_FRAME_MAX  6
+#define BARO_TXN_MAX    2
+#endif
 
 typedef struct baroDev_s {
   busDevice_t * busDev;
-  baroCalculateFuncPtr calculate;
-  uint8_t sensorType; // Used by the interface to get the types of sensors we have
-  float pressure;  // valid after calculate
-  float temperature; // valid after calculate
+  busTransaction_t txn[BARO_TXN_MAX];
+  uint8_t txnCount; // Queued by baroStartRead(), not yet picked up
+  uint8_t frame[BARO_FRAME_MAX]; // Raw pressure and temperature land here
+#ifdef WANT_COHERENT_SAMPLING
+  busTransaction_t triggerTxn;  // The write that starts a forced conversion
+  uint8_t triggerValue;
+  uint16_t conversionMicros;    // From the trigger to the result being ready
+  bool pressureConverted;       // False if the last conversion was temperature only (SPL06)
+#endif
+#ifdef WANT_SENSOR_DRDY
+  uint8_t intStatusReg;         // 0 if it has no data ready interrupt, it is then read every time
+  uint8_t intStatusReady;       // The bit in it that says there is a new sample
+  uint8_t intStatus;
+  busTransaction_t statusTxn;
+#endif
+#ifdef WANT_SENSOR_FIFO
+  uint8_t frameLength;          // Bytes of FIFO data queued by baroStartRead()
+  baroSample_t samples[BARO_FIFO_DEPTH]; // From the last baroCalculate(), oldest first, calculateVenturiValues() steps through them
+  uint8_t sampleCount;
+  unsigned long drainMicros;    // When the FIFO was last emptied
+#endif
+  uint8_t failedSamples; // In a row
+  uint8_t sensorType; // Picks the driver, and the interface reports it
 
   union {
 #ifdef WANT_BMP280
@@ -100,7 +166,13 @@ typedef struct baroDev_s {
 #endif
 #ifdef WANT_BMP388
     struct {
+#ifdef WANT_FIXED_POINT_COMPENSATION
+      bmp388_raw_param_t raw;   // The fixed point version works straight from the registers
+      int32_t t_lin;            // Q16 degrees C, from bmp388CompensateTemperature()
+#else
       bmp388_calib_param_t cal;
+      float t_lin;              // From bmp388CompensateTemperature()
+#endif
       // uncompensated pressure and temperature
       int32_t up;
       int32_t ut;
@@ -112,14 +184,72 @@ typedef struct baroDev_s {
 #ifdef WANT_SPL06
     struct {
       spl06_coeffs_t cal;
+#ifdef WANT_FIXED_POINT_COMPENSATION
+      spl06_fixed_coeffs_t fixed;
+#endif
       // uncompensated pressure and temperature
       int32_t pressure_raw;
       int32_t temperature_raw;
+      uint8_t temperatureCountdown; // Samples until temperature is read again, 0 reads it next time
+      bool temperatureDue;          // The frame being read includes temperature
     } spl06;
 #endif
   } chip;
 } baroDev_t;
 
-void detectIndividualSensor(uint8_t devNum, uint8_t sensorNum, TwoWire *wire, uint8_t address, uint8_t channel, busDevice_t *muxDevice, busDeviceEnableCbk enableCbk);
+// What each sample produces, one slot per sensors[] entry.  Kept out of baroDev_t so
+// calibration and the flow calculations walk a few contiguous words rather than
+// striding over the bus state and calibration unions of every chip.
+typedef struct baroData_s {
+  float pressure[4];             // valid after baroCalculate()
+  float temperature[4];          // valid after baroCalculate()
+  unsigned long sampleMicros[4]; // When the last read for the current frame finished
+} baroData_t;
+
+bool baroStartRead(baroDev_t *baro);
+bool baroCalculate(baroDev_t *baro);
+void baroAbandonRead(baroDev_t *baro);
+#ifdef WANT_COHERENT_SAMPLING
+bool baroTriggerAll(const uint8_t *order);
+bool baroWaitConversions();
+#endif
+#ifdef WANT_SENSOR_DRDY
+void baroDrdyInit();
+uint8_t baroDataReady();
+#endif
+
+#ifdef WANT_SAMPLING_PROFILES
+// Oversampling, rate and IIR filter for every sensor, picked with "S,sampling,<name>"
+typedef enum {
+  SAMPLING_LOW_LATENCY = 0, // Fastest rate, least oversampling, no filter
+  SAMPLING_BALANCED,        // What the drivers use without WANT_SAMPLING_PROFILES
+  SAMPLING_LOW_NOISE,       // Most oversampling and the IIR filter, at a lower rate
+  SAMPLING_PROFILE_MAX
+} samplingProfile_e;
+
+// How each profile has done while it was in use, see the 'N' command
+typedef struct samplingStats_s {
+  unsigned long activeMillis;   // Up to the last switch away from it, baroProfileStatsReport() adds the rest
+  unsigned long samples;        // Sample sets from readVISP()
+  unsigned long acquireMicros;  // Total, from the reads being queued to the last one landing
+  unsigned long maxAcquireMicros;
+  unsigned long transactions;   // Sensor bus transactions (devices 0-3)
+  unsigned long updates;        // New values from the ambient sensor
+  unsigned long updateMicros;   // Total time between them
+  float noiseSquares;           // Sum of the squared differences between them, Pa^2
+} samplingStats_t;
+
+extern uint8_t samplingProfile; // The setting, baroApplyProfile() puts it on the sensors
+extern const char strLowLatency[];
+extern const char strBalanced[];
+extern const char strLowNoise[];
+
+void baroApplyProfile();
+bool baroProfileSettling();
+void baroProfileRecord(uint8_t ambient, unsigned long acquireMicros);
+void baroProfileStatsReport();
+void baroProfileStatsClear();
+#endif
+char detectIndividualSensor(pt_t *pt, uint8_t devNum, uint8_t sensorNum, TwoWire *wire, uint8_t address, uint8_t channel, busDevice_t *muxDevice, busDeviceEnableCbk enableCbk);
 
 #endif
@@ -16,6 +16,44 @@
 #define WANT_BMP280 1
 #define WANT_SPL06  1
 
+#define WANT_TASK_STATS 1 // Per task runtime histograms, see the 'T' command
+#define WANT_PROFILING  1 // Cycle counts for the hot path, see the 'P' command
+#define WANT_TRACE      1 // Event trace ring buffer, see the 'X' command
+#define WANT_ASYNC_I2C  1 // Interrupt driven sensor reads, see busasync.cpp
+#define WANT_ASYNC_SPI  1 // DMA sensor reads for an SPI VISP
+//#define WANT_SENSOR_FIFO 1 // SPL06 and BMP388 sample at their full rate into their FIFOs, drained each read, and the venturi flow is stepped through every sample (not with WANT_SAMPLING_PROFILES)
+
+// Oversampling, rate and filter profiles that can be switched with "S,sampling,<name>" (see the
+// 'N' command).  Take it out for WANT_SENSOR_FIFO or WANT_COHERENT_SAMPLING, they have their own.
+#define WANT_SAMPLING_PROFILES 1
+
+// SPI VISP chip selects for U5-U8, define all four to have detectVISP() look for one.
+// SPI itself is on 11, 12 and 13.
+//#define VISP_SPI_CS_U5 10
+//#define VISP_SPI_CS_U6 9
+//#define VISP_SPI_CS_U7 24
+//#define VISP_SPI_CS_U8 25
+
+// Trigger forced conversions on all four sensors together, so each sample is a time aligned set.
+// Not with WANT_SENSOR_FIFO or WANT_SENSOR_DRDY, those let the sensors run free, or WANT_SAMPLING_PROFILES.
+//#define WANT_COHERENT_SAMPLING 1
+
+// Sensor data ready interrupts, read each sensor as soon as it has a new sample instead of every 20ms.
+// One pin per sensor.  BMP388s can share one as a wired-OR line (we set them open drain, active low),
+// an SPL06 cannot, its output is push-pull.  An SPL06 found on a shared pin is read every time instead.
+//#define WANT_SENSOR_DRDY 1
+#define VISP_DRDY_PIN_U5 26
+#define VISP_DRDY_PIN_U6 27
+#define VISP_DRDY_PIN_U7 28
+#define VISP_DRDY_PIN_U8 29
+
+#define I2C_CLOCK_MAX 1000000 // The LPI2C, SPL06 and BMP388 all do Fast mode plus
+
+// Sample the sensors and run the PID from an IntervalTimer instead of loop()
+//#define WANT_CONTROL_TIMER 1
+#define CONTROL_TICK_HZ       100 // FastPID is told this rate, so it really is fixed
+#define CONTROL_TICK_PRIORITY 192 // Below the serial ports and I2C (0 is highest, 255 lowest)
+
 #define MAX_ANALOG 4096
 #define MAX_PWM 65536
 
@@ -0,0 +1,102 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+
+   Author: Steven.Carr@hammontonmakers.org
+*/
+
+
+#include "config.h"
+
+#ifdef WANT_TRACE
+static traceEvent_t traceBuffer[TRACE_EVENTS];
+static volatile uint32_t traceHead = 0; // Total events ever recorded, the buffer index is the bottom bits
+static volatile bool traceFrozen = false;
+
+// Called from interrupts too (home sensor, encoder, control tick)
+void traceEvent(uint8_t type, uint8_t arg, uint16_t value)
+{
+  if (traceFrozen)
+    return;
+
+  noInterrupts();
+  traceEvent_t *e = &traceBuffer[traceHead & (TRACE_EVENTS - 1)];
+  traceHead++;
+  e->timestamp = micros();
+  e->type = type;
+  e->arg = arg;
+  e->value = value;
+  interrupts();
+}
+
+static void tracePrintHex(uint32_t value, uint8_t bytes)
+{
+  // Little endian, so the dump does not depend on how the compiler laid out the struct
+  for (uint8_t x = 0; x < bytes; x++, value >>= 8)
+  {
+    uint8_t b = value & 0xFF;
+    hwSerial.print("0123456789abcdef"[b >> 4]);
+    hwSerial.print("0123456789abcdef"[b & 0x0F]);
+  }
+}
+
+// X,<t>,begin,<events>,<events lost>
+// X,<t>,task,<index>,<name>           (one per task, to name TRACE_TASK_xxx events)
+// X,<t>,data,<hex>                     (up to 16 events per line)
+// X,<t>,end
+void traceDump()
+{
+  uint32_t head, count, x;
+
+  // Stop recording while we print, or the dump would mostly be about itself
+  traceFrozen = true;
+  head = traceHead;
+  count = (head > TRACE_EVENTS ? TRACE_EVENTS : head);
+
+  respond('X', PSTR("begin,%l,%l"), (long)count, (long)(head - count));
+  for (x = 0; schedulerTaskName(x); x++)
+    respond('X', PSTR("task,%d,%S"), (int)x, schedulerTaskName(x));
+
+  for (x = 0; x < count; x++)
+  {
+    traceEvent_t *e = &traceBuffer[(head - count + x) & (TRACE_EVENTS - 1)];
+
+    if ((x & 15) == 0)
+    {
+      if (x)
+        hwSerial.println();
+      hwSerial.print(F("X,"));
+      hwSerial.print(millis());
+      hwSerial.print(F(",data,"));
+    }
+    tracePrintHex(e->timestamp, 4);
+    tracePrintHex(e->type, 1);
+    tracePrintHex(e->arg, 1);
+    tracePrintHex(e->value, 2);
+  }
+  if (count)
+    hwSerial.println();
+  respond('X', PSTR("end"));
+
+  traceFrozen = false;
+}
+
+void traceClear()
+{
+  noInterrupts();
+  traceHead = 0;
+  interrupts();
+}
+#endif
@@ -0,0 +1,72 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+
+   Author: Steven.Carr@hammontonmakers.org
+*/
+
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+// Timestamped event trace kept in a RAM ring buffer, dumped with the 'X' command.
+// software/core/tools/visp_trace_decode.py turns a dump into Chrome/Perfetto trace JSON.
+//
+// Each event is 8 bytes: micros(), the event type, an 8 bit argument and a 16 bit value.
+// Once the buffer is full the oldest events are overwritten.
+// Without WANT_TRACE the TRACE() calls compile to nothing.
+typedef enum {
+  TRACE_NONE = 0,
+  TRACE_TASK_START,        // arg: task table index
+  TRACE_TASK_END,          // arg: task table index
+  TRACE_I2C_START,         // arg: bus << 4 | device number (DEVICE_xxx), see busTraceArg(), value: register
+  TRACE_I2C_END,           // arg: as above, value: 0 on success
+  TRACE_COMPENSATE_START,  // arg: sensor number (SENSOR_Ux)
+  TRACE_COMPENSATE_END,    // arg: sensor number
+  TRACE_PID_START,
+  TRACE_PID_END,           // value: new motor speed
+  TRACE_MOTOR_COMMAND,     // arg: motor run state, value: motor speed
+  TRACE_SERIAL_TX,         // arg: response type ('d', 'i', ...), value: free space in the transmit buffer
+  TRACE_HOME_IRQ,
+  TRACE_ENCODER_IRQ,       // value: low 16 bits of the encoder count
+  TRACE_DISPLAY_START,     // arg: device number of the display being drawn
+  TRACE_DISPLAY_END,
+  TRACE_MAX
+} traceEvent_e;
+
+#ifdef WANT_TRACE
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 512 // Must be a power of 2
+#endif
+
+typedef struct traceEvent_s {
+  uint32_t timestamp;
+  uint8_t type;
+  uint8_t arg;
+  uint16_t value;
+} traceEvent_t;
+
+void traceEvent(uint8_t type, uint8_t arg, uint16_t value);
+void traceDump();
+void traceClear();
+
+#define TRACE(type, arg, value) traceEvent((type), (arg), (value))
+
+#else
+#define TRACE(type, arg, value)
+#endif
+
+#endif
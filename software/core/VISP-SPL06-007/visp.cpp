@@ -40,14 +40,74 @@ float tidalVolume = 0.0; // Maybe used for VC-CMV definitely safety limits
 uint8_t calibrationSampleCounter = 0;
 #define CALIBRATION_FINISHED 99
 
+#define DETECTION_INTERVAL 500 // ms between attempts to find a VISP
+#define VISP_EEPROM_READS    3 // Attempts at reading the VISP EEPROM before giving up on it
+
 vispBusType_e detectedVispType = VISP_BUS_TYPE_NONE;
 
 baroDev_t sensors[4]; // See mappings SENSOR_U[5678] and PATIENT_PRESSURE, AMBIENT_PRESSURE, PITOT1, PITOT2
+baroData_t sensorData; // Their results, indexed the same way
 bool sensorsFound = false;
 
+#ifdef WANT_CONTROL_TIMER
+// Sequence lock: odd while the control tick is writing the sample.
+// The control tick cannot be interrupted by the background loop, so only the reader ever retries.
+static volatile uint8_t vispSampleSequence = 0;
+static vispSample_t vispSample;
+static volatile bool sensorFailurePending = false;
+
+void vispPublishSample()
+{
+  vispSampleSequence++;
+  __asm__ __volatile__("" ::: "memory");
+  vispSample.timestamp = millis();
+  vispSample.pressure = pressure;
+  vispSample.volume = volume;
+  vispSample.tidalVolume = tidalVolume;
+  for (uint8_t x = 0; x < 4; x++)
+    vispSample.sensorPressure[x] = sensorData.pressure[x];
+  __asm__ __volatile__("" ::: "memory");
+  vispSampleSequence++;
+}
+
+void vispReadSample(vispSample_t *sample)
+{
+  uint8_t sequence;
+
+  do {
+    sequence = vispSampleSequence;
+    __asm__ __volatile__("" ::: "memory");
+    memcpy(sample, &vispSample, sizeof(vispSample_t));
+    __asm__ __volatile__("" ::: "memory");
+  } while ((sequence & 1) || sequence != vispSampleSequence);
+}
+
+// handleSensorFailure() from the control tick cannot print, so it is reported from here
+void vispReportSensorFailure()
+{
+  if (sensorFailurePending)
+  {
+    sensorFailurePending = false;
+    sendCurrentSystemHealth();
+    critical(PSTR("Sensor communication failure"));
+  }
+}
+#else
+void vispReadSample(vispSample_t *sample)
+{
+  sample->timestamp = millis();
+  sample->pressure = pressure;
+  sample->volume = volume;
+  sample->tidalVolume = tidalVolume;
+  for (uint8_t x = 0; x < 4; x++)
+    sample->sensorPressure[x] = sensorData.pressure[x];
+}
+#endif
+
 void vispInit()
 {
   memset(&sensors, 0, sizeof(sensors));
+  memset(&sensorData, 0, sizeof(sensorData));
   ambientPressure = 0.0, throatPressure = 0.0;
   pressure = 0.0; // Used for PC-CMV
   volume = 0.0; // Used for VC-CMV
@@ -66,24 +126,32 @@ void formatVisp(busDevice_t *busDev, struct visp_eeprom_s *data, uint8_t busType
   //  // Make *sure* that the calibration data is formatted properly
   //  calibrateClear();
 
-  writeEEPROM(busDev, (unsigned short)0, (unsigned char *)&visp_eeprom, sizeof(visp_eeprom));
+  eepromStartWrite(busDev, (unsigned short)0, (unsigned char *)&visp_eeprom, sizeof(visp_eeprom));
 }
 void saveParametersToVISP()
 {
   visp_eeprom.checksum = 0;
   // TODO: compute checksum
-  writeEEPROM(eeprom, (unsigned short)0, (unsigned char *)&visp_eeprom, sizeof(visp_eeprom));
+  // Written out in the background by eepromService()
+  eepromStartWrite(eeprom, (unsigned short)0, (unsigned char *)&visp_eeprom, sizeof(visp_eeprom));
 }
 
 void handleSensorFailure()
 {
   for (uint8_t x = 0; x < 4; x++)
   {
+    baroAbandonRead(&sensors[x]);
     sensors[x].busDev = NULL;
-    sensors[x].calculate = NULL;
     sensors[x].sensorType = SENSOR_UNKNOWN;
   }
   sensorsFound = false;
+#ifdef WANT_CONTROL_TIMER
+  if (inControlTick)
+  {
+    sensorFailurePending = true;
+    return;
+  }
+#endif
   sendCurrentSystemHealth();
   critical(PSTR("Sensor communication failure"));
 }
@@ -94,11 +162,62 @@ void detectEEPROM(TwoWire * wire, uint8_t address, uint8_t muxChannel, busDevice
   if (busDeviceDetect(thisDevice))
   {
     thisDevice->hwType = HWTYPE_EEPROM;
+    thisDevice->verifyLength = 16; // The VISP signature and body type
     eeprom = thisDevice;
   }
 }
 
 
+// Where each sensor may be found on a VISP.  Sites are probed in order, a sensor that has
+// already been found is not probed again (the BMP388 channels of the MUX board reuse them).
+typedef struct sensorSite_s {
+  uint8_t devNum;
+  uint8_t baroNum;
+  uint8_t address;
+  uint8_t channel; // MUX channel, 0 if not muxed
+  uint8_t bus;     // SITE_BUS_A, SITE_BUS_B or SITE_BUS_SPI
+} sensorSite_t;
+
+#define SITE_BUS_A   0
+#define SITE_BUS_B   1
+#define SITE_BUS_SPI 2 // address is the chip select pin
+
+const sensorSite_t muxedSites[] PUTINFLASH = {
+  // U5, U6 and U7, U8
+  {DEVICE_SENSOR_U5, SENSOR_U5, 0x76, 1, SITE_BUS_A},
+  {DEVICE_SENSOR_U6, SENSOR_U6, 0x77, 1, SITE_BUS_A},
+  {DEVICE_SENSOR_U7, SENSOR_U7, 0x76, 2, SITE_BUS_A},
+  {DEVICE_SENSOR_U8, SENSOR_U8, 0x77, 2, SITE_BUS_A},
+  // BMP388's are on buses 3 & 4 (and U5&U6 are swapped addresses <by accident>)
+  {DEVICE_SENSOR_U5, SENSOR_U5, 0x77, 3, SITE_BUS_A},
+  {DEVICE_SENSOR_U6, SENSOR_U6, 0x76, 3, SITE_BUS_A},
+  {DEVICE_SENSOR_U7, SENSOR_U7, 0x76, 4, SITE_BUS_A},
+  {DEVICE_SENSOR_U8, SENSOR_U8, 0x77, 4, SITE_BUS_A}
+};
+
+const sensorSite_t dualI2CSites[] PUTINFLASH = {
+  {DEVICE_SENSOR_U5, SENSOR_U5, 0x76, 0, SITE_BUS_A},
+  {DEVICE_SENSOR_U6, SENSOR_U6, 0x77, 0, SITE_BUS_A},
+  {DEVICE_SENSOR_U7, SENSOR_U7, 0x76, 0, SITE_BUS_B},
+  {DEVICE_SENSOR_U8, SENSOR_U8, 0x77, 0, SITE_BUS_B}
+};
+
+#ifdef VISP_SPI_CS_U8
+const sensorSite_t spiSites[] PUTINFLASH = {
+  {DEVICE_SENSOR_U5, SENSOR_U5, VISP_SPI_CS_U5, 0, SITE_BUS_SPI},
+  {DEVICE_SENSOR_U6, SENSOR_U6, VISP_SPI_CS_U6, 0, SITE_BUS_SPI},
+  {DEVICE_SENSOR_U7, SENSOR_U7, VISP_SPI_CS_U7, 0, SITE_BUS_SPI},
+  {DEVICE_SENSOR_U8, SENSOR_U8, VISP_SPI_CS_U8, 0, SITE_BUS_SPI}
+};
+#endif
+
+// Filled in by detectMuxedSensors()/detectDualI2CSensors()/detectSPISensors() for detectVISP() to walk through
+static const sensorSite_t *siteList;
+static uint8_t siteCount;
+static TwoWire *siteWire[3];   // NULL for SITE_BUS_SPI, the devices are set up by detectSPISensors()
+static busDeviceEnableCbk siteEnableCbk[3];
+static busDevice_t *siteMux;
+
 bool detectMuxedSensors(TwoWire *wire, busDeviceEnableCbk enableCbk)
 {
   // MUX has a switching chip that can have different adresses (including ones on our devices)
@@ -113,25 +232,14 @@ bool detectMuxedSensors(TwoWire *wire, busDeviceEnableCbk enableCbk)
 
   detectEEPROM(wire, 0x54, 1, muxDevice, enableCbk);
 
-  // Detect U5, U6
-  detectIndividualSensor(DEVICE_SENSOR_U5, SENSOR_U5, wire, 0x76, 1, muxDevice, enableCbk);
-  detectIndividualSensor(DEVICE_SENSOR_U6, SENSOR_U6, wire, 0x77, 1, muxDevice, enableCbk);
-  // Detect U7, U8
-  detectIndividualSensor(DEVICE_SENSOR_U7, SENSOR_U7, wire, 0x76, 2, muxDevice, enableCbk);
-  detectIndividualSensor(DEVICE_SENSOR_U8, SENSOR_U8, wire, 0x77, 2, muxDevice, enableCbk);
-
-  // BMP388's are on buses 3 & 4 (and U5&U6 are swapped addresses <by accident>)
-  // Detect U5, U6 (Mistake on board, these 2 are plased in reversed order)
-  detectIndividualSensor(DEVICE_SENSOR_U5, SENSOR_U5, wire, 0x77, 3, muxDevice, enableCbk);
-  detectIndividualSensor(DEVICE_SENSOR_U6, SENSOR_U6, wire, 0x76, 3, muxDevice, enableCbk);
-  // Detect U7, U8
-  detectIndividualSensor(DEVICE_SENSOR_U7, SENSOR_U7, wire, 0x76, 4, muxDevice, enableCbk);
-  detectIndividualSensor(DEVICE_SENSOR_U8, SENSOR_U8, wire, 0x77, 4, muxDevice, enableCbk);
-
+  siteList = muxedSites;
+  siteCount = sizeof(muxedSites) / sizeof(sensorSite_t);
+  siteWire[SITE_BUS_A] = siteWire[SITE_BUS_B] = wire;
+  siteEnableCbk[SITE_BUS_A] = siteEnableCbk[SITE_BUS_B] = enableCbk;
+  siteMux = muxDevice; // Do not free muxDevice, as it is shared by the sensors
 
   detectedVispType = VISP_BUS_TYPE_MUX;
 
-  // Do not free muxDevice, as it is shared by the sensors
   return true;
 }
 
@@ -159,46 +267,102 @@ bool detectDualI2CSensors(TwoWire * wireA, TwoWire * wireB, busDeviceEnableCbk e
 
   detectEEPROM(wireA, 0x54, 0, NULL, enableCbkA);
 
+  siteList = dualI2CSites;
+  siteCount = sizeof(dualI2CSites) / sizeof(sensorSite_t);
+  siteWire[SITE_BUS_A] = wireA;
+  // TEENSY has dual i2c busses, NANO does not, it uses the Primary I2C bus with an enable pin
+  siteWire[SITE_BUS_B] = (wireB ? wireB : wireA);
+  siteEnableCbk[SITE_BUS_A] = enableCbkA;
+  siteEnableCbk[SITE_BUS_B] = enableCbkB;
+  siteMux = NULL;
 
-  // Detect U5, U6
-  detectIndividualSensor(DEVICE_SENSOR_U5, SENSOR_U5, wireA, 0x76, 0, NULL, enableCbkA);
-  detectIndividualSensor(DEVICE_SENSOR_U6, SENSOR_U6, wireA, 0x77, 0, NULL, enableCbkA);
+  detectedVispType = VISP_BUS_TYPE_I2C;
 
-  // TEENSY has dual i2c busses, NANO does not.
-  // Detect U7, U8
-  if (wireB)
-  {
-    //debug(PSTR("TEENSY second I2C bus"));
-    detectIndividualSensor(DEVICE_SENSOR_U7, SENSOR_U7, wireB, 0x76, 0, NULL, enableCbkB);
-    detectIndividualSensor(DEVICE_SENSOR_U8, SENSOR_U8, wireB, 0x77, 0, NULL, enableCbkB);
-  }
-  else
+  return true;
+}
+
+
+#ifdef VISP_SPI_CS_U8
+// Nothing on SPI acknowledges, so look for a chip ID behind U5's chip select
+bool detectSPISensors(SPIClass *spi)
+{
+  sensorSite_t s;
+  uint8_t chipId;
+
+  // Every chip select has to be high before talking to any of them
+  for (uint8_t site = 0; site < sizeof(spiSites) / sizeof(sensorSite_t); site++)
   {
-    //debug(PSTR("No second HW I2C, using Primary I2C bus with enable pin"));
-    detectIndividualSensor(DEVICE_SENSOR_U7, SENSOR_U7, wireA, 0x76, 0, NULL, enableCbkB);
-    detectIndividualSensor(DEVICE_SENSOR_U8, SENSOR_U8, wireA, 0x77, 0, NULL, enableCbkB);
+    memcpy_P(&s, &spiSites[site], sizeof(s));
+    busDeviceInitSPI(s.devNum, spi, s.address);
   }
 
-  detectedVispType = VISP_BUS_TYPE_I2C;
+  busDevice_t *busDev = &devices[DEVICE_SENSOR_U5];
+  bool found = (busRead(busDev, 0x0D, &chipId) && chipId == 0x10);        // SPL06
+  found = found || (busRead(busDev, 0xD0, &chipId) && chipId == 0x58);    // BMP280
+  busDev->busdev.spi.readDummy = 1;
+  found = found || (busRead(busDev, 0x00, &chipId) && chipId == 0x50);    // BMP388
+  busDev->busdev.spi.readDummy = 0;
+  if (!found)
+    return false;
+
+  siteList = spiSites;
+  siteCount = sizeof(spiSites) / sizeof(sensorSite_t);
+  siteWire[SITE_BUS_A] = siteWire[SITE_BUS_B] = siteWire[SITE_BUS_SPI] = NULL;
+  siteEnableCbk[SITE_BUS_SPI] = spiChipSelectCbk;
+  siteMux = NULL;
+
+  detectedVispType = VISP_BUS_TYPE_SPI;
 
   return true;
 }
+#else
+bool detectSPISensors(SPIClass *spi)
+{
+  return false;
+}
+#endif
 
 
 const char strBasedType[] PUTINFLASH = " Based VISP Detected"; // Save some bytes in flash
 // FUTURE: read EEPROM and determine what type of VISP it is.
-void detectVISP(TwoWire * i2cBusA, TwoWire * i2cBusB, busDeviceEnableCbk enableCbkA, busDeviceEnableCbk enableCbkB)
+// Protothread (see pt.h), poll it until it returns PT_ENDED/PT_EXITED, sensorsFound says how it went.
+// Each call probes at most one sensor, the retries and reset waits happen between calls.
+char detectVISP(TwoWire * i2cBusA, TwoWire * i2cBusB, busDeviceEnableCbk enableCbkA, busDeviceEnableCbk enableCbkB)
 {
+  static pt_t pt, sitePt;
+  static uint8_t site;
+  static sensorSite_t s; // PT_SPAWN passes it again on every resume
+  static char result;
+  static uint8_t attempt;
   bool format = false;
   uint8_t missing;
+
+  PT_BEGIN(&pt);
+
   memset(&sensors, 0, sizeof(sensors));
+  eeprom = NULL;
+  busClockReset(i2cBusA);
+  busClockReset(i2cBusB);
 
   // debug(PSTR("Detecting sensors"));
 
   if (!detectMuxedSensors(i2cBusA, enableCbkA))
     if (!detectMuxedSensors(i2cBusA, enableCbkB))
       if (!detectDualI2CSensors(i2cBusA, i2cBusB, enableCbkA, enableCbkB))
-        return;
+        if (!detectSPISensors(&SPI))
+        {
+          PT_SLEEP(&pt, DETECTION_INTERVAL);
+          PT_EXIT(&pt);
+        }
+
+  for (site = 0; site < siteCount; site++)
+  {
+    memcpy_P(&s, &siteList[site], sizeof(s));
+    if (sensors[s.baroNum].busDev)
+      continue;
+    PT_SPAWN(&pt, &sitePt, detectIndividualSensor(&sitePt, s.devNum, s.baroNum, siteWire[s.bus], s.address, s.channel, siteMux, siteEnableCbk[s.bus]), result);
+    PT_YIELD(&pt);
+  }
 
   // Make sure they are all there
   missing = 0;
@@ -211,7 +375,8 @@ void detectVISP(TwoWire * i2cBusA, TwoWire * i2cBusB, busDeviceEnableCbk enableC
     sensorsFound = 0;
 
     eeprom = NULL;
-    return;
+    PT_SLEEP(&pt, DETECTION_INTERVAL);
+    PT_EXIT(&pt);
   }
 
   //if (detectedVispType == VISP_BUS_TYPE_I2C) debug(PSTR("DUAL I2C%S"), strBasedType);
@@ -221,9 +386,23 @@ void detectVISP(TwoWire * i2cBusA, TwoWire * i2cBusB, busDeviceEnableCbk enableC
   if (eeprom)
   {
     //debug(PSTR("Reading VISP EEPROM"));
-    readEEPROM(eeprom, 0, (unsigned char *)&visp_eeprom, sizeof(visp_eeprom));
+    PT_WAIT_WHILE(&pt, eepromBusy()); // A save from before the sensors went missing
+    for (attempt = 0; attempt < VISP_EEPROM_READS; attempt++)
+    {
+      eepromStartRead(eeprom, 0, (unsigned char *)&visp_eeprom, sizeof(visp_eeprom));
+      PT_WAIT_WHILE(&pt, eepromBusy());
+      if (eepromSucceeded())
+        break;
+    }
 
-    if (visp_eeprom.VISP != VISP_SIGNATURE)
+    if (attempt == VISP_EEPROM_READS)
+    {
+      // Leave what is on it alone, run on the defaults and treat it as missing until re-detected
+      warning(PSTR("VISP eeprom unreadable"));
+      eeprom = NULL;
+      format = true;
+    }
+    else if (visp_eeprom.VISP != VISP_SIGNATURE)
     {
       // ok, unformatted VISP
       format = true;
@@ -240,6 +419,10 @@ void detectVISP(TwoWire * i2cBusA, TwoWire * i2cBusB, busDeviceEnableCbk enableC
   if (format)
     formatVisp(eeprom, &visp_eeprom, detectedVispType, VISP_BODYTYPE_VENTURI);
 
+  busClockNegotiate(siteWire[SITE_BUS_A]);
+  if (siteWire[SITE_BUS_B] != siteWire[SITE_BUS_A])
+    busClockNegotiate(siteWire[SITE_BUS_B]);
+
   sensorsFound = true;
 
   // Just put it out there, what type we are for the status system to figure out
@@ -247,6 +430,8 @@ void detectVISP(TwoWire * i2cBusA, TwoWire * i2cBusB, busDeviceEnableCbk enableC
 
   primeTheFrontEnd(); // Updates all of the buttons...
   sendCurrentSystemHealth();
+
+  PT_END(&pt);
 }
 
 void  __NOINLINE calibrateClear()
@@ -259,7 +444,7 @@ void  __NOINLINE calibrateClear()
 void  __NOINLINE calibrateApply()
 {
   for (int x = 0; x < 4; x++)
-    sensors[x].pressure += calibrationOffsets[x];
+    sensorData.pressure[x] += calibrationOffsets[x];
 }
 
 void calibrateSensors()
@@ -269,12 +454,16 @@ void calibrateSensors()
   // If we are moving motors around, we cannot calibrate the sensor properly
   if (!motorDetectionInProgress())
   {
+    // With WANT_CONTROL_TIMER the control tick writes sensorData under us, so work from its sample
+    vispSample_t sample;
+
+    vispReadSample(&sample);
     if (calibrationSampleCounter == 1)
       respond('C', PSTR("0,Starting Calibration"));
     for (x = 0; x < 4; x++)
-      calibrationOffsets[x] += sensors[x].pressure;
-    calibrationSampleCounter++;
-    if (calibrationSampleCounter == CALIBRATION_FINISHED) {
+      calibrationOffsets[x] += sample.sensorPressure[x];
+    // The offsets must be complete before calibrateInProgress() says so, the control tick applies them
+    if (calibrationSampleCounter + 1 == CALIBRATION_FINISHED) {
       float average = 0.0;
       for (x = 0; x < 4; x++)
         average += calibrationOffsets[x];
@@ -282,8 +471,11 @@ void calibrateSensors()
 
       for (x = 0; x < 4; x++)
         calibrationOffsets[x] = average - (calibrationOffsets[x] / 100.0);
+      calibrationSampleCounter++;
       respond('C', PSTR("2,Calibration Finished"));
     }
+    else
+      calibrationSampleCounter++;
   }
 }
 
@@ -294,7 +486,17 @@ bool calibrateInProgress()
 
 
 
-// Use these definitions to map sensors output sensor[SENSOR_Ux] to their usage
+static unsigned long lastFlowMicros = 0;
+
+// Adds volume, flowing since the last call, into tidalVolume
+static void integrateFlow(unsigned long flowMicros)
+{
+  if (lastFlowMicros)
+    tidalVolume = tidalVolume + volume * (flowMicros - lastFlowMicros) / 60000.0; // tidal volume is the volume delivered to the patient at this time.  So it is cumulative.
+  lastFlowMicros = flowMicros;
+}
+
+// Use these definitions to map sensors output sensorData.pressure[SENSOR_Ux] to their usage
 #define THROAT_PRESSURE  SENSOR_U5
 #define AMBIANT_PRESSURE SENSOR_U6
 #define PITOT1           SENSOR_U7
@@ -302,13 +504,14 @@ bool calibrateInProgress()
 
 void calculatePitotValues()
 {
+  PROFILE_SCOPE(PROFILE_PITOT);
   const float paTocmH2O = 0.0101972;
   float  airflow, roughVolume, pitot_diff, pitot1, pitot2;
 
-  pitot1 = sensors[PITOT1].pressure;
-  pitot2 = sensors[PITOT2].pressure;
-  ambientPressure = sensors[AMBIANT_PRESSURE].pressure;
-  throatPressure = sensors[THROAT_PRESSURE].pressure;
+  pitot1 = sensorData.pressure[PITOT1];
+  pitot2 = sensorData.pressure[PITOT2];
+  ambientPressure = sensorData.pressure[AMBIANT_PRESSURE];
+  throatPressure = sensorData.pressure[THROAT_PRESSURE];
   pressure = (throatPressure - ambientPressure) * paTocmH2O;
 
   pitot_diff = (pitot1 - pitot2) / 100.0; // pascals to hPa
@@ -322,31 +525,24 @@ void calculatePitotValues()
 
   // TODO: smoothing for Pitot version
   volume = roughVolume = airflow * 0.25 * 60.0; // volume for our 18mm orfice, and 60s/min
+  integrateFlow(micros());
 }
 
 
-// Use these definitions to map sensors output sensors[SENSOR_Ux] to their usage
+// Use these definitions to map sensors output sensorData.pressure[SENSOR_Ux] to their usage
 //U7 is input tube, U8 is output tube, U5 is venturi, U6 is ambient
 #define VENTURI_SENSOR  SENSOR_U5
 #define VENTURI_AMBIANT SENSOR_U6
 #define VENTURI_INPUT   SENSOR_U7
 #define VENTURI_OUTPUT  SENSOR_U8
-void calculateVenturiValues()
+// Flow through the venturi, positive towards the patient, 0 if it is too small to tell
+static float venturiFlow(float inletPressure, float outletPressure, float throatPressure)
 {
-  const float paTocmH2O = 0.0101972;
   // venturi calculations
   const float aPipe = 232.35219306;
   const float aRestriction = 56.745017403;
   const float a_diff = (aPipe * aRestriction) / sqrt((aPipe * aPipe) - (aRestriction * aRestriction)); // area difference
-  float roughVolume, inletPressure, outletPressure;
-
-  //    static float paTocmH2O = 0.00501972;
-  ambientPressure = sensors[VENTURI_AMBIANT].pressure;
-  inletPressure = sensors[VENTURI_INPUT].pressure;
-  outletPressure = sensors[VENTURI_OUTPUT].pressure;
-  // patientPressure = sensors[VENTURI_SENSOR].pressure;   // This is not used?
-  throatPressure = sensors[VENTURI_SENSOR].pressure;
-  pressure = ((inletPressure + outletPressure) / 2.0 - ambientPressure) * paTocmH2O;
+  float roughVolume;
 
   //float h= ( inletPressure-throatPressure )/(9.81*998); //pressure head difference in m
   //airflow = a_diff * sqrt(2.0 * (inletPressure - throatPressure)) / 998.0) * 600000.0; // airflow in cubic m/s *60000 to get L/m
@@ -370,26 +566,82 @@ void calculateVenturiValues()
   {
     roughVolume = 0.0;
   }
+  return roughVolume;
+}
+
+#ifdef WANT_SENSOR_FIFO
+#define VOLUME_SMOOTHING_MICROS 20000.0 // The filter's 0.15 is for samples this far apart, one per readVISP()
+
+// What a sensor read at a time: its newest FIFO sample from then, or the oldest if they all came
+// after.  One with nothing new this time still has the mean of its last ones.
+static float baroPressureAt(uint8_t x, unsigned long sampleMicros)
+{
+  baroDev_t *baro = &sensors[x];
+  float pressure = sensorData.pressure[x];
+
+  for (uint8_t y = 0; y < baro->sampleCount; y++)
+  {
+    if (y && (long)(baro->samples[y].micros - sampleMicros) > 0)
+      break;
+    pressure = baro->samples[y].pressure;
+  }
+  return pressure;
+}
+#endif
+
+void calculateVenturiValues()
+{
+  PROFILE_SCOPE(PROFILE_VENTURI);
+  const float paTocmH2O = 0.0101972;
+  float inletPressure, outletPressure;
 
+  //    static float paTocmH2O = 0.00501972;
+  ambientPressure = sensorData.pressure[VENTURI_AMBIANT];
+  inletPressure = sensorData.pressure[VENTURI_INPUT];
+  outletPressure = sensorData.pressure[VENTURI_OUTPUT];
+  // patientPressure = sensorData.pressure[VENTURI_SENSOR];   // This is not used?
+  throatPressure = sensorData.pressure[VENTURI_SENSOR];
+  pressure = ((inletPressure + outletPressure) / 2.0 - ambientPressure) * paTocmH2O;
+
+#ifdef WANT_SENSOR_FIFO
+  // Step the flow through every sample the throat sensor gave, with the other two at that time,
+  // rather than once through their means.  A sample not after the last one is not counted twice.
+  baroDev_t *throat = &sensors[VENTURI_SENSOR];
+
+  for (uint8_t y = 0; y < throat->sampleCount; y++)
+  {
+    unsigned long sampleMicros = throat->samples[y].micros;
+
+    if (lastFlowMicros && (long)(sampleMicros - lastFlowMicros) <= 0)
+      continue;
+
+    float roughVolume = venturiFlow(baroPressureAt(VENTURI_INPUT, sampleMicros), baroPressureAt(VENTURI_OUTPUT, sampleMicros),
+                                    throat->samples[y].pressure);
+    float alpha = (lastFlowMicros ? 1.0 - powf(0.85, (sampleMicros - lastFlowMicros) / VOLUME_SMOOTHING_MICROS) : 0.15);
+
+    if (alpha > 1.0)
+      alpha = 1.0;
+    volume = roughVolume * alpha + volume * (1.0 - alpha);
+    integrateFlow(sampleMicros);
+  }
+#else
   const float alpha = 0.15; // smoothing factor for exponential filter
-  volume = roughVolume * alpha + volume * (1.0 - alpha);
+  volume = venturiFlow(inletPressure, outletPressure, throatPressure) * alpha + volume * (1.0 - alpha);
+  integrateFlow(micros());
+#endif
 }
 
 
 void  __NOINLINE calculateTidalVolume()
 {
-  static unsigned long lastSampleTime = 0;
-  unsigned long sampleTime = millis();
+  PROFILE_SCOPE(PROFILE_TIDAL_VOLUME);
 
-  if (lastSampleTime)
-  {
-    tidalVolume = tidalVolume + volume * (sampleTime - lastSampleTime) / 60 - 0.1; // tidal volume is the volume delivered to the patient at this time.  So it is cumulative.
-  }
+  // The flow has been added up by the calculate*Values() that gave it
+  tidalVolume = tidalVolume - 0.1;
   if (tidalVolume < 0.0)
   {
     tidalVolume = 0.0;
   } else if (tidalVolume > 999.0) {
     tidalVolume = 999.0;
   }
-  lastSampleTime = sampleTime;
 }
@@ -110,16 +110,35 @@ extern float volume; // Used for VC-CMV
 extern float tidalVolume; // Maybe used for VC-CMV definitely safety limits
 
 extern baroDev_t sensors[4]; // See mappings SENSOR_U[5678] and PATIENT_PRESSURE, AMBIENT_PRESSURE, PITOT1, PITOT2
+extern baroData_t sensorData; // Their results, indexed the same way
 extern bool sensorsFound ;
 
+// A consistent copy of one reading, for the background loop to report on
+typedef struct vispSample_s {
+  unsigned long timestamp;
+  float pressure;
+  float volume;
+  float tidalVolume;
+  float sensorPressure[4];
+} vispSample_t;
+
+#ifdef WANT_CONTROL_TIMER
+void vispPublishSample(); // Only from the control tick
+void vispReportSensorFailure(); // Only from the background loop
+#else
+#define vispPublishSample()
+#endif
+void vispReadSample(vispSample_t *sample);
+
 void vispInit();
 
 void handleSensorFailure();
 void detectEEPROM(TwoWire * wire, uint8_t address, uint8_t muxChannel = 0, busDevice_t *muxDevice = NULL, busDeviceEnableCbk enableCbk = noEnableCbk);
 bool detectMuxedSensors(TwoWire *wire, busDeviceEnableCbk enableCbk = noEnableCbk);
 bool detectXLateSensors(TwoWire * wire, busDeviceEnableCbk enableCbk = noEnableCbk);
+bool detectSPISensors(SPIClass *spi);
 bool detectDualI2CSensors(TwoWire * wireA, TwoWire * wireB, busDeviceEnableCbk enableCbkA = noEnableCbk, busDeviceEnableCbk enableCbkB = noEnableCbk);
-void detectVISP(TwoWire * i2cBusA, TwoWire * i2cBusB, busDeviceEnableCbk enableCbkA = noEnableCbk, busDeviceEnableCbk enableCbkB = noEnableCbk);
+char detectVISP(TwoWire * i2cBusA, TwoWire * i2cBusB, busDeviceEnableCbk enableCbkA = noEnableCbk, busDeviceEnableCbk enableCbkB = noEnableCbk);
 void saveParametersToVISP();
 
 void calibrateClear();
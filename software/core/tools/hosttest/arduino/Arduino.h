@@ -0,0 +1,105 @@
+// Just enough of the Arduino core to compile the sensor code on a PC, see ../run.sh
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include <strings.h>
+typedef uint8_t byte;
+typedef bool boolean;
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define FALLING 2
+#define RISING 3
+#define CHANGE 4
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+#define A8 22
+#define A9 23
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void * const *)(p))
+#define memcpy_P memcpy
+#define strncpy_P strncpy
+#define strcasecmp_P strcasecmp
+#define strlen_P strlen
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(x,a,b) ((x)<(a)?(a):((x)>(b)?(b):(x)))
+#define digitalPinToInterrupt(p) (p)
+#define DEC 10
+#define HEX 16
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+void pinMode(uint8_t, uint8_t);
+void analogWrite(uint8_t, int);
+int analogRead(uint8_t);
+void attachInterrupt(uint8_t, void (*)(void), int);
+void detachInterrupt(uint8_t);
+void noInterrupts();
+void interrupts();
+class Print {
+public:
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *b, size_t n) { size_t r=0; while(n--) r+=write(*b++); return r; }
+  size_t write(const char *s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(const __FlashStringHelper *);
+  size_t print(const char *);
+  size_t print(char);
+  size_t print(unsigned char, int = DEC);
+  size_t print(int, int = DEC);
+  size_t print(unsigned int, int = DEC);
+  size_t print(long, int = DEC);
+  size_t print(unsigned long, int = DEC);
+  size_t print(double, int = 2);
+  size_t println();
+  template<typename T> size_t println(T t) { return print(t) + println(); }
+  template<typename T> size_t println(T t, int f) { return print(t, f) + println(); }
+};
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+};
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long);
+  size_t write(uint8_t) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int availableForWrite();
+  void flush();
+};
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+#ifdef ARDUINO_TEENSY40
+extern volatile uint32_t host_dwt[3];
+#define ARM_DEMCR host_dwt[0]
+#define ARM_DEMCR_TRCENA (1 << 24)
+#define ARM_DWT_CTRL host_dwt[1]
+#define ARM_DWT_CTRL_CYCCNTENA (1 << 0)
+#define ARM_DWT_CYCCNT host_dwt[2]
+extern volatile uint32_t F_CPU_ACTUAL;
+#endif
@@ -0,0 +1,3 @@
+// Declarations only, nothing the host checks call, see ../run.sh
+#pragma once
+class IntervalTimer { public: bool begin(void (*)(), unsigned int); bool begin(void (*)(), int); bool begin(void (*)(), long); bool begin(void (*)(), float); void end(); void priority(uint8_t); };
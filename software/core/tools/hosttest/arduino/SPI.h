@@ -0,0 +1,21 @@
+// Declarations only, nothing the host checks call, see ../run.sh
+#pragma once
+#include "Arduino.h"
+#define MSBFIRST 1
+#define SPI_MODE0 0
+#define SPI_MODE3 3
+class SPISettings { public: SPISettings(uint32_t, uint8_t, uint8_t) {} SPISettings() {} };
+class EventResponder { public: void attachImmediate(void (*)(EventResponder &)); void clearEvent(); int getStatus(); void *getContext(); void setContext(void*); };
+class SPIClass {
+public:
+  void begin();
+  void beginTransaction(SPISettings);
+  void endTransaction();
+  uint8_t transfer(uint8_t);
+  void transfer(void *, size_t);
+  void transfer(const void *, void *, size_t);
+#ifdef ARDUINO_TEENSY40
+  bool transfer(const void *, void *, size_t, EventResponder &);
+#endif
+};
+extern SPIClass SPI;
@@ -0,0 +1,24 @@
+// Declarations only, nothing the host checks call, see ../run.sh
+#pragma once
+#include "Arduino.h"
+#define BUFFER_LENGTH 32
+class TwoWire : public Stream {
+public:
+  void begin();
+  void setClock(uint32_t);
+  void beginTransmission(uint8_t);
+  uint8_t endTransmission(uint8_t stop = 1);
+  uint8_t requestFrom(uint8_t, uint8_t, uint8_t stop = 1);
+  uint8_t requestFrom(int, int);
+  size_t write(uint8_t) override;
+  size_t write(const uint8_t *, size_t) override;
+  using Print::write;
+  size_t write(int n) { return write((uint8_t)n); }
+  size_t write(unsigned long n) { return write((uint8_t)n); }
+  size_t write(long n) { return write((uint8_t)n); }
+  size_t write(unsigned int n) { return write((uint8_t)n); }
+  int available() override;
+  int read() override;
+};
+extern TwoWire Wire;
+extern TwoWire Wire1;
@@ -0,0 +1,2 @@
+// Host build stand in, see ../../run.sh
+#pragma once
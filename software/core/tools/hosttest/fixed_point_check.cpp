@@ -0,0 +1,408 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// WANT_FIXED_POINT_COMPENSATION against the datasheet formulas in float and double, over the
+// raw input range.  Built for the Nano with all three sensor types, see run.sh.  Fails if any
+// error goes past the bounds below.
+
+#include "sensors.cpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef WANT_FIXED_POINT_COMPENSATION
+#error "Build this with WANT_FIXED_POINT_COMPENSATION, see run.sh"
+#endif
+
+// The bounds are worked out from the code rather than from what it gave.  fixedMulHigh() is
+// up to 2 under the floor of the exact product, so under 3 LSB of the true one, and each error
+// is carried through the Q formats that follow.  Against double that is all, plus half a
+// float step of the largest result the trimming can give.  Against the float formulas it also
+// takes in their own rounding, n roundings of 2^-24 of the sum of the terms' sizes, which is
+// far looser than they really are.  FIXED_MARGIN goes on top of every bound.
+#define FIXED_MUL_ERROR 3.0
+#define FIXED_MARGIN    1.25
+#define LSB(q)                 ldexp(1.0, -(q))
+#define HALF_FLOAT_STEP(most)  ldexp(1.0, ilogb(most) - 24)
+#define FLOAT_ROUNDING(n, sum) ((n) * ldexp((double)(sum), -24))
+
+static int failures = 0;
+
+static void checkBound(const char *what, double error, double bound)
+{
+  bool ok = (error <= bound);
+
+  printf("  %-34s %9.6f  (bound %.6f) %s\n", what, error, bound, ok ? "ok" : "FAILED");
+  if (!ok)
+    failures++;
+}
+
+static int32_t randomBetween(int32_t lo, int32_t hi)
+{
+  return lo + (int32_t)((((uint64_t)rand() << 31) ^ rand()) % (uint64_t)(hi - lo + 1));
+}
+
+// SPL06 datasheet 4.6.1, from the raw coefficients
+template<class F> static F spl06Pressure(spl06_coeffs_t *c, int32_t pressureRaw, int32_t temperatureRaw)
+{
+  F ps = (F)pressureRaw / 7864320, ts = (F)temperatureRaw / 524288;
+
+  return (F)c->c00 + ps * ((F)c->c10 + ps * ((F)c->c20 + ps * c->c30)) + ts * ((F)c->c01 + ps * ((F)c->c11 + ps * c->c21));
+}
+
+static double spl06Temperature(spl06_coeffs_t *c, int32_t temperatureRaw)
+{
+  return (double)c->c0 / 2 + (double)temperatureRaw / 524288 * c->c1;
+}
+
+// ps and ts are the raw values / 2^19, so up to 16, and every multiply by one scales the error
+// so far by 16.  The folded coefficients are rounded to half an LSB.  Pascals.
+static double spl06PressureError()
+{
+  double cubic = 0.5 * LSB(26) * 16 + FIXED_MUL_ERROR * LSB(20) + 0.5 * LSB(20); // c30 * ps + c20, Q20
+  cubic = cubic * 16 + FIXED_MUL_ERROR * LSB(14) + 0.5 * LSB(14);                 // * ps + c10, Q14
+  cubic = cubic * 16 + FIXED_MUL_ERROR * LSB(8);                                 // * ps, Q8
+  double cross = 0.5 * LSB(23) * 16 + FIXED_MUL_ERROR * LSB(17) + 0.5 * LSB(17); // c21 * ps + c11, Q17
+  cross = cross * 16 + FIXED_MUL_ERROR * LSB(11);                                // * ps, Q11, << 2 for c01
+  cross = cross * 16 + FIXED_MUL_ERROR * LSB(7);                                 // * ts, Q7, << 1
+  return cubic + cross;
+}
+
+// The datasheet's terms at their largest, the scaled pressure is up to 16/15 at 8x
+static double spl06PressureTerms()
+{
+  double ps = 16.0 / 15, ts = 16;
+
+  return 524288 + 524288 * ps + 32768 * (ps * ps + ps * ps * ps + ts + ts * ps + ts * ps * ps);
+}
+
+static void checkSPL06()
+{
+  baroDev_t baro;
+  spl06_coeffs_t *c = &baro.chip.spl06.cal;
+  static const int32_t temperatures[] = { -8388608, -1048576, -200000, 0, 150000, 1048576, 8388607 };
+  double maxFloat = 0, maxDouble = 0, maxTemperature = 0;
+  long samples = 0;
+
+  // A real part at every 24 bit pressure, then random coefficients over their register ranges.
+  // The first few random sets have the higher order coefficients pinned at their extremes.
+  for (int set = 0; set < 24; set++)
+  {
+    if (set == 0)
+    {
+      c->c0 = 204; c->c1 = -261; c->c00 = 80469; c->c10 = -54769; c->c01 = -2757;
+      c->c11 = 1242; c->c20 = -10616; c->c21 = 188; c->c30 = -1327;
+    }
+    else
+    {
+      c->c0 = randomBetween(-2048, 2047); c->c1 = randomBetween(-2048, 2047);
+      c->c00 = randomBetween(-524288, 524287); c->c10 = randomBetween(-524288, 524287);
+      c->c01 = randomBetween(-32768, 32767); c->c11 = randomBetween(-32768, 32767);
+      c->c20 = randomBetween(-32768, 32767); c->c21 = randomBetween(-32768, 32767); c->c30 = randomBetween(-32768, 32767);
+      if (set < 4)
+      {
+        c->c10 = (set & 1) ? -524288 : 524287;
+        c->c11 = (set & 2) ? -32768 : 32767;
+        c->c20 = c->c21 = c->c30 = (set & 1) ? 32767 : -32768;
+        c->c01 = -32768;
+      }
+    }
+    // As spl06_read_calibration_coefficients() does
+    baro.chip.spl06.fixed.c10 = spl06_fold_coefficient(c->c10, 14, SPL06_FIXED_PRESSURE_FOLD);
+    baro.chip.spl06.fixed.c20 = spl06_fold_coefficient(c->c20, 20, SPL06_FIXED_PRESSURE_FOLD * SPL06_FIXED_PRESSURE_FOLD);
+    baro.chip.spl06.fixed.c30 = spl06_fold_coefficient(c->c30, 26, SPL06_FIXED_PRESSURE_FOLD * SPL06_FIXED_PRESSURE_FOLD * SPL06_FIXED_PRESSURE_FOLD);
+    baro.chip.spl06.fixed.c11 = spl06_fold_coefficient(c->c11, 17, SPL06_FIXED_PRESSURE_FOLD);
+    baro.chip.spl06.fixed.c21 = spl06_fold_coefficient(c->c21, 23, SPL06_FIXED_PRESSURE_FOLD * SPL06_FIXED_PRESSURE_FOLD);
+
+    for (int32_t temperatureRaw : temperatures)
+    {
+      double error = fabs(spl06_compensate_temperature(&baro, temperatureRaw) - spl06Temperature(c, temperatureRaw));
+      if (error > maxTemperature)
+        maxTemperature = error;
+
+      for (int32_t pressureRaw = -8388608; pressureRaw < 8388608; pressureRaw += (set == 0 ? 1 : 61))
+      {
+        float fixed = spl06_compensate_pressure(&baro, pressureRaw, temperatureRaw);
+        double errorFloat = fabs(fixed - spl06Pressure<float>(c, pressureRaw, temperatureRaw));
+        double errorDouble = fabs(fixed - spl06Pressure<double>(c, pressureRaw, temperatureRaw));
+
+        if (errorFloat > maxFloat)
+          maxFloat = errorFloat;
+        if (errorDouble > maxDouble)
+          maxDouble = errorDouble;
+        samples++;
+      }
+    }
+  }
+
+  // ps is rounded once and goes into the c30 term three times, then seven multiplies and adds
+  double doubleBound = spl06PressureError() + HALF_FLOAT_STEP(spl06PressureTerms());
+  double floatBound = doubleBound + FLOAT_ROUNDING(10, spl06PressureTerms());
+  // One fixedMulHigh() at Q14, to a float of up to 2^16 (c0 / 2 + 16 * c1)
+  double temperatureBound = FIXED_MUL_ERROR * LSB(14) + HALF_FLOAT_STEP(1024 + 16 * 2048);
+
+  printf("SPL06, %ld samples\n", samples);
+  checkBound("pressure, fixed - float", maxFloat, FIXED_MARGIN * floatBound);
+  checkBound("pressure, fixed - double", maxDouble, FIXED_MARGIN * doubleBound);
+  checkBound("temperature, fixed - double", maxTemperature, FIXED_MARGIN * temperatureBound);
+}
+
+// BMP388 datasheet 9.2 and 9.3, floating point trimming from the raw registers
+template<class F> struct bmp388Reference
+{
+  F T1, T2, T3, P1, P2, P3, P4, P5, P6, P7, P8, P9, P10, P11;
+
+  bmp388Reference(bmp388_raw_param_t *r)
+  {
+    T1 = (F)r->param_T1 * 256; T2 = (F)r->param_T2 / pow(2.0, 30); T3 = (F)r->param_T3 / pow(2.0, 48);
+    P1 = ((F)r->param_P1 - 16384) / pow(2.0, 20); P2 = ((F)r->param_P2 - 16384) / pow(2.0, 29);
+    P3 = (F)r->param_P3 / pow(2.0, 32); P4 = (F)r->param_P4 / pow(2.0, 37);
+    P5 = (F)r->param_P5 * 8; P6 = (F)r->param_P6 / 64; P7 = (F)r->param_P7 / 256; P8 = (F)r->param_P8 / pow(2.0, 15);
+    P9 = (F)r->param_P9 / pow(2.0, 48); P10 = (F)r->param_P10 / pow(2.0, 48); P11 = (F)r->param_P11 / pow(2.0, 65);
+  }
+  F temperature(int32_t ut)
+  {
+    F d1 = (F)ut - T1;
+    return d1 * T2 + d1 * d1 * T3;
+  }
+  F pressure(int32_t up, F t)
+  {
+    F u = (F)up;
+    F offset = P5 + P6 * t + P7 * t * t + P8 * t * t * t;
+    F sensitivity = u * (P1 + P2 * t + P3 * t * t + P4 * t * t * t);
+    return offset + sensitivity + u * u * (P9 + P10 * t) + u * u * u * P11;
+  }
+};
+
+// The register ranges the trimming is scaled from, and t_lin's clamp
+#define BMP388_T         85.0
+#define BMP388_UP        16777216.0                                      // 2^24
+#define BMP388_P2        (49152 * LSB(29))                               // (P2 - 2^14) / 2^29
+#define BMP388_P5        (65535 * 8.0)
+#define BMP388_P6        (65535 * LSB(6))
+#define BMP388_S         (49152 * LSB(20) + BMP388_P2 * BMP388_T + 128 * BMP388_T * BMP388_T * LSB(32) + 128 * BMP388_T * BMP388_T * BMP388_T * LSB(37))
+
+// t_lin, degrees C.  d1 * T2 at Q18 then >> 2.  d1 squared is off by 3 of its 2^-18 LSBs, that
+// times T3 (up to 128 * 2^-48) is the first part of the T3 term, which is at Q22 then >> 6.
+static double bmp388TemperatureError()
+{
+  return FIXED_MUL_ERROR * LSB(18) + LSB(16) + FIXED_MUL_ERROR * 128 * LSB(30) + FIXED_MUL_ERROR * LSB(22) + LSB(16);
+}
+
+// Pascals, from a t_lin that is already off by bmp388TemperatureError()
+static double bmp388PressureError()
+{
+  double t = BMP388_T, temperature = bmp388TemperatureError();
+  double square = 2 * t * temperature + FIXED_MUL_ERROR * LSB(16);                     // Q16
+  double cube = square * t + t * t * temperature + FIXED_MUL_ERROR * LSB(8);           // Q8
+  double offset = BMP388_P6 * temperature + FIXED_MUL_ERROR * LSB(12) + LSB(8)          // P6 at Q12, >> 4
+                  + (square + LSB(8)) * 128 * LSB(8) + LSB(8)                          // P7, t_lin2 >> 8
+                  + (cube + 0.5) * 128 * LSB(15) + LSB(8);                             // P8, t_lin3 >> 7 is Q1
+  double data2 = 128 * temperature * 256 + 1 + 2 * FIXED_MUL_ERROR;                    // P9 to P11, in 2^-56
+  double sensitivity = BMP388_P2 * temperature + (FIXED_MUL_ERROR / 8 + 1) * LSB(32)  // Q32
+                       + ((square + LSB(8)) * 128 + 1) * LSB(32)
+                       + ((cube * 8 + 1) * 128 * LSB(8) + 1) * LSB(32)
+                       + (data2 + 2 * FIXED_MUL_ERROR) * LSB(32);                      // up * data2 / 2^24 at most data2
+  return offset + BMP388_UP * sensitivity + 2 * FIXED_MUL_ERROR * LSB(8);
+}
+
+static double bmp388PressureTerms()
+{
+  double t = BMP388_T;
+
+  return BMP388_P5 + BMP388_P6 * t + 128 * LSB(8) * t * t + 128 * LSB(15) * t * t * t + BMP388_UP * BMP388_S
+         + BMP388_UP * BMP388_UP * (32768 + 128 * t) * LSB(48) + BMP388_UP * BMP388_UP * BMP388_UP * 128 * LSB(65);
+}
+
+// How far the pressure moves for a degree, for the float temperature's rounding
+static double bmp388PressurePerDegree()
+{
+  double t = BMP388_T;
+
+  return BMP388_P6 + 2 * 128 * LSB(8) * t + 3 * 128 * LSB(15) * t * t
+         + BMP388_UP * (BMP388_P2 + 2 * 128 * t * LSB(32) + 3 * 128 * t * t * LSB(37)) + BMP388_UP * BMP388_UP * 128 * LSB(48);
+}
+
+static void checkBMP388()
+{
+  baroDev_t baro;
+  bmp388_raw_param_t *r = &baro.chip.bmp388.raw;
+  double maxFloat = 0, maxDouble = 0, maxTemperature = 0;
+  long samples = 0;
+
+  // A real part, then random trimming over the register ranges, with the temperature kept to -40..85 C
+  for (int set = 0; set < 40; set++)
+  {
+    if (set == 0)
+    {
+      r->param_T1 = 27632; r->param_T2 = 19228; r->param_T3 = -7; r->param_P1 = -1376; r->param_P2 = -3149;
+      r->param_P3 = 35; r->param_P4 = 1; r->param_P5 = 19985; r->param_P6 = 22725; r->param_P7 = 3;
+      r->param_P8 = -9; r->param_P9 = 12510; r->param_P10 = 17; r->param_P11 = -60;
+    }
+    else
+    {
+      r->param_T1 = randomBetween(0, 65535); r->param_T2 = randomBetween(0, 65535); r->param_T3 = randomBetween(-128, 127);
+      r->param_P1 = randomBetween(-32768, 32767); r->param_P2 = randomBetween(-32768, 32767);
+      r->param_P3 = randomBetween(-128, 127); r->param_P4 = randomBetween(-128, 127);
+      r->param_P5 = randomBetween(0, 65535); r->param_P6 = randomBetween(0, 65535);
+      r->param_P7 = randomBetween(-128, 127); r->param_P8 = randomBetween(-128, 127);
+      r->param_P9 = randomBetween(-32768, 32767); r->param_P10 = randomBetween(-128, 127); r->param_P11 = randomBetween(-128, 127);
+    }
+    bmp388Reference<float> single(r);
+    bmp388Reference<double> dbl(r);
+
+    for (int32_t ut = 0; ut < (1L << 24); ut += 4099)
+    {
+      double temperature = dbl.temperature(ut);
+      if (temperature < -40 || temperature > 85)
+        continue;
+
+      baro.chip.bmp388.ut = ut;
+      double error = fabs(bmp388CompensateTemperature(&baro) - temperature);
+      if (error > maxTemperature)
+        maxTemperature = error;
+      float temperatureFloat = single.temperature(ut);
+
+      for (int32_t up = 0; up < (1L << 24); up += (set == 0 ? 257 : 4093))
+      {
+        baro.chip.bmp388.up = up;
+        float fixed = bmp388CompensatePressure(&baro);
+        double errorFloat = fabs(fixed - single.pressure(up, temperatureFloat));
+        double errorDouble = fabs(fixed - dbl.pressure(up, temperature));
+
+        if (errorFloat > maxFloat)
+          maxFloat = errorFloat;
+        if (errorDouble > maxDouble)
+          maxDouble = errorDouble;
+        samples++;
+      }
+    }
+  }
+
+  // Within -40..85 C, d1 * T2 is at most 85 + 128 and d1 squared * T3 at most 128.  The float
+  // temperature takes three roundings, the pressure twelve on the way to u cubed * P11.
+  double doubleBound = bmp388PressureError() + HALF_FLOAT_STEP(bmp388PressureTerms());
+  double floatBound = doubleBound + FLOAT_ROUNDING(12, bmp388PressureTerms())
+                      + FLOAT_ROUNDING(3, BMP388_T + 2 * 128) * bmp388PressurePerDegree();
+
+  printf("BMP388, %ld samples\n", samples);
+  checkBound("pressure, fixed - float", maxFloat, FIXED_MARGIN * floatBound);
+  checkBound("pressure, fixed - double", maxDouble, FIXED_MARGIN * doubleBound);
+  checkBound("temperature, fixed - double", maxTemperature, FIXED_MARGIN * bmp388TemperatureError());
+}
+
+// BMP280 datasheet 8.2, the 64 bit version, Q24.8 Pa
+static uint32_t bmp280Pressure64(bmp280_calib_param_t *cal, int32_t adc_P)
+{
+  int64_t var1, var2, p;
+
+  var1 = ((int64_t)cal->t_fine) - 128000;
+  var2 = var1 * var1 * (int64_t)cal->dig_P6;
+  var2 = var2 + ((var1 * (int64_t)cal->dig_P5) << 17);
+  var2 = var2 + (((int64_t)cal->dig_P4) << 35);
+  var1 = ((var1 * var1 * (int64_t)cal->dig_P3) >> 8) + ((var1 * (int64_t)cal->dig_P2) << 12);
+  var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)cal->dig_P1) >> 33;
+  if (var1 == 0)
+    return 0;
+  p = 1048576 - adc_P;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = (((int64_t)cal->dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+  var2 = (((int64_t)cal->dig_P8) * p) >> 19;
+  return (uint32_t)(((p + var1 + var2) >> 8) + (((int64_t)cal->dig_P7) << 4));
+}
+
+// How far the 32 bit version can be from the 64 bit one for the trimming checkBMP280() uses,
+// in Pascals.  Both are Q8 at the end.
+static double bmp280PressureError()
+{
+  double a = (BMP280_FIXED_T_FINE_MAX - 128000) / 2.0;  // t_fine / 2 - 64000, from the 64 bit var1, floored
+  double p1 = 36477 - 3000, p2 = 10685 + 1000, p3 = 3024 + 500, p5 = 140 + 100, p6 = 7 + 5;
+
+  // var2 (the offset) in 2^-12 raw counts: a / 4 floored and squared, >> 11, >> 2, and a's own
+  // half in the square and in P5.  Then rounded to a whole count.
+  double offset = 2 * (a / 4) * LSB(11) * p6 / 4 + p6 / 4 + 1 + 2 * a * 0.5 * p6 * LSB(17) + 0.5 * p5 * 2 / 4;
+  double counts = 0.5 + offset / 4096;
+  // var1 (the sensitivity) is P1 << 12 times 1 + a fraction of 2^30, the smallest makes the most
+  // Pascals of a count.  Its floors: a's half in P2, a / 4 squared >> 13 in P3, and the shifts.
+  double sensitivity = (p1 * 4096) * (1 - p2 * a / 16 * LSB(30));
+  double pascalsPerCount = 3125 * ldexp(1.0, 21) / sensitivity / 256;
+  double relative = (p2 * 0.5 / 16 + 2 + 2 * (a / 4) * 0.75 * LSB(13) * p3 / 64 + 2 * a * 0.5 / 16 * LSB(13) * p3 / 64 + p3 / 64 + 2) * LSB(30)
+                    + FIXED_MUL_ERROR / sensitivity;
+  // P9 and P8 are two fixedMulHigh() each, and the 64 bit version floors twice
+  double tail = (FIXED_MUL_ERROR * 7000 * LSB(23) + 2 * FIXED_MUL_ERROR + 2) * LSB(8);
+
+  return counts * pascalsPerCount + relative * 110000 + tail;
+}
+
+static void checkBMP280()
+{
+  baroDev_t baro;
+  bmp280_calib_param_t *c = &baro.chip.bmp280.cal;
+  double maxError = 0;
+  long samples = 0;
+
+  // The datasheet's example trimming, then perturbed copies of it, across -40..85 C
+  for (int set = 0; set < 12; set++)
+  {
+    c->dig_T1 = 27504; c->dig_T2 = 26435; c->dig_T3 = -1000; c->dig_P1 = 36477; c->dig_P2 = -10685; c->dig_P3 = 3024;
+    c->dig_P4 = 2855; c->dig_P5 = 140; c->dig_P6 = -7; c->dig_P7 = 15500; c->dig_P8 = -14600; c->dig_P9 = 6000;
+    if (set)
+    {
+      c->dig_T1 += randomBetween(-3000, 3000); c->dig_T2 += randomBetween(-2000, 2000);
+      c->dig_P1 += randomBetween(-3000, 3000); c->dig_P2 += randomBetween(-1000, 1000); c->dig_P3 += randomBetween(-500, 500);
+      c->dig_P4 += randomBetween(-2000, 2000); c->dig_P5 += randomBetween(-100, 100); c->dig_P6 += randomBetween(-5, 5);
+      c->dig_P7 += randomBetween(-1000, 1000); c->dig_P8 += randomBetween(-1000, 1000); c->dig_P9 += randomBetween(-1000, 1000);
+    }
+    for (int32_t adc_T = 300000; adc_T <= 700000; adc_T += 20000)
+    {
+      bmp280CompensateTemperature(&baro, adc_T);
+      if (c->t_fine < -204800 || c->t_fine > 435200)
+        continue;
+
+      for (int32_t adc_P = 0; adc_P < (1L << 20); adc_P += (set == 0 ? 1 : 7))
+      {
+        double reference = bmp280Pressure64(c, adc_P) / 256.0;
+
+        // The datasheet's 32 bit version is only good for 300..1100 hPa
+        if (reference < 30000 || reference > 110000)
+          continue;
+        double error = fabs(bmp280CompensatePressure(&baro, adc_P) / 256.0 - reference);
+        if (error > maxError)
+          maxError = error;
+        samples++;
+      }
+    }
+  }
+
+  printf("BMP280, %ld samples in 300..1100 hPa\n", samples);
+  checkBound("pressure, fixed - 64 bit", maxError, FIXED_MARGIN * bmp280PressureError());
+}
+
+int main()
+{
+  srand(1);
+  checkSPL06();
+  checkBMP280();
+  checkBMP388();
+
+  if (failures)
+  {
+    printf("%d over their bound\n", failures);
+    return 1;
+  }
+  printf("All within bounds\n");
+  return 0;
+}
@@ -0,0 +1,60 @@
+/*
+   This file is part of VISP Core.
+
+   VISP Core is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   VISP Core is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with VISP Core.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// What sensors.cpp needs from the rest of the sketch when it is built on a PC.
+// The host checks only call the compensation code, so the bus never answers.
+
+#include "config.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+baroDev_t sensors[4];
+baroData_t sensorData;
+bool sensorsFound = false;
+
+busDevice_t devices[DEVICE_MAX];
+busDeviceStats_t busDeviceStats[DEVICE_MAX];
+
+#ifdef ARDUINO_TEENSY40
+volatile uint32_t host_dwt[3];
+volatile uint32_t F_CPU_ACTUAL = 600000000;
+#endif
+
+unsigned long millis() { return 0; }
+
+void respond(char command, PGM_P fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "%c: ", command);
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+}
+
+void handleSensorFailure() {}
+void profileRecord(uint8_t, uint32_t) {}
+void traceEvent(uint8_t, uint8_t, uint16_t) {}
+
+busDevice_t *busDeviceInitI2C(uint8_t, TwoWire *, uint8_t, uint8_t, busDevice_t *, busDeviceEnableCbk, hwType_e) { return NULL; }
+void busPrint(busDevice_t *, const char *) {}
+bool busReadBuf(busDevice_t *, unsigned short, unsigned char *, uint8_t) { return false; }
+bool busRead(busDevice_t *, unsigned short, unsigned char *) { return false; }
+bool busWrite(busDevice_t *, unsigned short, unsigned char) { return false; }
+bool busReadBufAsync(busTransaction_t *, busDevice_t *, unsigned short, uint8_t *, uint8_t, busTransactionCbk) { return false; }
+bool busTransactionWait(busTransaction_t *) { return false; }
+bool busTransactionWaitRetry(busTransaction_t *, uint8_t) { return false; }
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Builds and runs the host checks of the sensor compensation with the PC's g++.
+#
+#   fixed_point_check  WANT_FIXED_POINT_COMPENSATION against float and double, as the Nano builds it
+#
+# Usage: run.sh [check...], fixed_point_check by default.  Exits non-zero if one fails.
+# CXXFLAGS are added to every build, for example "-mfma -ffp-contract=fast" to let g++ fuse multiplies.
+#
+# The PC's int is 32 bits where the Nano's is 16, so sums that the AVR promotes to a 16 bit int
+# are worked out wider here.  Those paths are not checked by this, only the 32 bit arithmetic.
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+SKETCH="$HERE/../../VISP-SPL06-007"
+OUT=${TMPDIR:-/tmp}/visp-hosttest
+CXX=${CXX:-g++}
+CHECKS=${*:-fixed_point_check}
+
+mkdir -p "$OUT" || exit 1
+
+build() # source output board-and-flags...
+{
+  source=$1
+  output=$2
+  shift 2
+  $CXX -std=gnu++14 -O2 -Wall -Wextra $CXXFLAGS "$@" -I"$SKETCH" -I"$HERE/arduino" -include Arduino.h \
+    "$HERE/$source.cpp" "$HERE/hoststubs.cpp" -o "$OUT/$output" -lm
+}
+
+failed=0
+for check in $CHECKS
+do
+  echo "== $check"
+  case $check in
+    fixed_point_check)
+      build $check $check -DARDUINO_AVR_NANO -DWANT_BMP388 -DWANT_BMP280 && "$OUT/$check" ;;
+    *)
+      echo "No such check" ; false ;;
+  esac || failed=1
+done
+exit $failed
@@ -0,0 +1,172 @@
+# visp_trace_decode.py
+# Converts the 'X' trace dump from a VISP Core serial log into Chrome trace JSON.
+# Open the result in chrome://tracing or https://ui.perfetto.dev
+#
+# Event layout and types must match software/core/VISP-SPL06-007/trace.h
+
+import sys
+import json
+import struct
+
+if (len(sys.argv) < 2):
+    print("Usage: visp_trace_decode.py <serial log> [output.json]")
+    exit()
+
+# traceEvent_e
+TRACE_TASK_START = 1
+TRACE_TASK_END = 2
+TRACE_I2C_START = 3
+TRACE_I2C_END = 4
+TRACE_COMPENSATE_START = 5
+TRACE_COMPENSATE_END = 6
+TRACE_PID_START = 7
+TRACE_PID_END = 8
+TRACE_MOTOR_COMMAND = 9
+TRACE_SERIAL_TX = 10
+TRACE_HOME_IRQ = 11
+TRACE_ENCODER_IRQ = 12
+TRACE_DISPLAY_START = 13
+TRACE_DISPLAY_END = 14
+
+# DEVICE_xxx from busdevice.h
+DEVICES = ["SensorU5", "SensorU6", "SensorU7", "SensorU8", "EEPROM", "Mux", "VISPDisplay", "CoreDisplay"]
+SENSORS = ["U5", "U6", "U7", "U8"]
+MOTOR_STATES = {0: "Stopped", 1: "Homing", 2: "Running"}
+
+# One row in the viewer for each of these
+TID_TASKS = 1
+TID_DISPLAY = 2
+TID_I2C = 3  # Buses that could not be told apart, each I2C bus and SPI get their own from TID_BUS
+TID_COMPENSATE = 4
+TID_PID = 5
+TID_IRQ = 6
+TID_SERIAL = 7
+TID_BUS = 10
+BUS_SPI = 0x0F  # BUS_TRACE_SPI in busdevice.h
+THREAD_NAMES = {TID_TASKS: "tasks", TID_DISPLAY: "display", TID_I2C: "i2c", TID_COMPENSATE: "compensate",
+                TID_PID: "pid", TID_IRQ: "interrupts", TID_SERIAL: "serial"}
+
+# Pick up the last complete dump in the log, other output is ignored
+taskNames = {}
+data = ""
+dumps = []
+with open(sys.argv[1], errors="replace") as file:
+    for line in file:
+        fields = line.strip().split(",")
+        if len(fields) < 3 or fields[0] != "X":
+            continue
+        if fields[2] == "begin":
+            taskNames = {}
+            data = ""
+        elif fields[2] == "task" and len(fields) >= 5:
+            taskNames[int(fields[3])] = fields[4]
+        elif fields[2] == "data" and len(fields) >= 4:
+            data += fields[3]
+        elif fields[2] == "end":
+            dumps.append((dict(taskNames), data))
+
+if len(dumps) == 0:
+    print("No complete trace dump found in " + sys.argv[1])
+    exit(1)
+
+taskNames, data = dumps[-1]
+raw = bytes.fromhex(data)
+
+
+def deviceName(dev):
+    return DEVICES[dev] if dev < len(DEVICES) else "Device%d" % dev
+
+
+# The TRACE_I2C_xxx arg is the bus in the high nibble and the device in the low one, each bus gets
+# its own row because both I2C buses are busy at the same time on a dual I2C VISP
+busTids = {}
+
+
+def busTid(arg):
+    bus = arg >> 4
+    if bus == 0:
+        return TID_I2C
+    tid = TID_BUS + bus
+    if tid not in busTids:
+        busTids[tid] = "spi" if bus == BUS_SPI else "i2c bus %d" % bus
+    return tid
+
+
+def sensorName(sensor):
+    return SENSORS[sensor] if sensor < len(SENSORS) else "Sensor%d" % sensor
+
+
+events = []
+for tid, name in THREAD_NAMES.items():
+    events.append({"ph": "M", "name": "thread_name", "pid": 1, "tid": tid, "args": {"name": name}})
+
+# The oldest events may have been overwritten, so drop an end that has no start
+depth = {}
+lastStamp = None
+wraps = 0
+for offset in range(0, len(raw) - 7, 8):
+    stamp, kind, arg, value = struct.unpack_from("<IBBH", raw, offset)
+
+    # micros() wraps every ~71 minutes
+    if lastStamp is not None and stamp < lastStamp:
+        wraps += 1
+    lastStamp = stamp
+    ts = stamp + wraps * (1 << 32)
+
+    begin = None
+    end = None
+    if kind == TRACE_TASK_START:
+        begin = (TID_TASKS, taskNames.get(arg, "task%d" % arg), {})
+    elif kind == TRACE_TASK_END:
+        end = TID_TASKS
+    elif kind == TRACE_DISPLAY_START:
+        begin = (TID_DISPLAY, deviceName(arg), {})
+    elif kind == TRACE_DISPLAY_END:
+        end = TID_DISPLAY
+    elif kind == TRACE_I2C_START:
+        begin = (busTid(arg), deviceName(arg & 0x0F), {"register": "0x%02x" % value})
+    elif kind == TRACE_I2C_END:
+        end = busTid(arg)
+        endArgs = {"error": value}
+    elif kind == TRACE_COMPENSATE_START:
+        begin = (TID_COMPENSATE, sensorName(arg), {})
+    elif kind == TRACE_COMPENSATE_END:
+        end = TID_COMPENSATE
+    elif kind == TRACE_PID_START:
+        begin = (TID_PID, "pid", {})
+    elif kind == TRACE_PID_END:
+        end = TID_PID
+        endArgs = {"speed": value}
+    elif kind == TRACE_MOTOR_COMMAND:
+        events.append({"ph": "C", "name": "motorSpeed", "pid": 1, "ts": ts, "args": {"speed": value}})
+        events.append({"ph": "i", "s": "t", "name": MOTOR_STATES.get(arg, "Motor%d" % arg),
+                       "pid": 1, "tid": TID_IRQ, "ts": ts, "args": {"speed": value}})
+    elif kind == TRACE_SERIAL_TX:
+        events.append({"ph": "i", "s": "t", "name": chr(arg), "pid": 1, "tid": TID_SERIAL, "ts": ts})
+        events.append({"ph": "C", "name": "serialTxFree", "pid": 1, "ts": ts, "args": {"bytes": value}})
+    elif kind == TRACE_HOME_IRQ:
+        events.append({"ph": "i", "s": "t", "name": "home", "pid": 1, "tid": TID_IRQ, "ts": ts})
+    elif kind == TRACE_ENCODER_IRQ:
+        events.append({"ph": "i", "s": "t", "name": "encoder", "pid": 1, "tid": TID_IRQ, "ts": ts,
+                       "args": {"count": value}})
+
+    if begin is not None:
+        tid, name, args = begin
+        depth[tid] = depth.get(tid, 0) + 1
+        events.append({"ph": "B", "name": name, "pid": 1, "tid": tid, "ts": ts, "args": args})
+    if end is not None and depth.get(end, 0) > 0:
+        depth[end] -= 1
+        event = {"ph": "E", "pid": 1, "tid": end, "ts": ts}
+        if kind in (TRACE_I2C_END, TRACE_PID_END):
+            event["args"] = endArgs
+        events.append(event)
+
+for tid, name in busTids.items():
+    events.append({"ph": "M", "name": "thread_name", "pid": 1, "tid": tid, "args": {"name": name}})
+
+output = json.dumps({"traceEvents": events, "displayTimeUnit": "ms"}, indent=1)
+if len(sys.argv) > 2:
+    with open(sys.argv[2], "w") as file:
+        file.write(output)
+else:
+    print(output)